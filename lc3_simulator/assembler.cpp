@@ -0,0 +1,711 @@
+#include "assembler.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static std::map<std::string, word> make_mnemonics()
+{
+    std::map<std::string, word> m;
+    m["BR"] = 30;
+    m["BRp"] = 31;
+    m["BRz"] = 32;
+    m["BRzp"] = 33;
+    m["BRn"] = 34;
+    m["BRnp"] = 35;
+    m["BRnz"] = 36;
+    m["BRnzp"] = 37;
+    m["ADD"] = 1;
+    m["LD"] = 2;
+    m["ST"] = 3;
+    m["JSR"] = 4;
+    m["JSRR"] = 40;
+    m["AND"] = 5;
+    m["LDR"] = 6;
+    m["STR"] = 7;
+    m["RTI"] = 8;
+    m["NOT"] = 9;
+    m["LDI"] = 10;
+    m["STI"] = 11;
+    m["RET"] = 12;
+    m["LEA"] = 14;
+    m["TRAP"] = 15;
+    m["JMP"] = 41;
+    m["GETC"] = 50;
+    m["OUT"] = 51;
+    m["PUTS"] = 52;
+    m["IN"] = 53;
+    m["PUTSP"] = 54;
+    m["HALT"] = 55;
+    m["MUL"] = 60;          //extension ops, 1101 DR SR1 op SR2
+    m["DIV"] = 61;
+    m["MOD"] = 62;
+    m["SHL"] = 63;
+    m["SHR"] = 64;
+    m["SRA"] = 65;
+    m["MCPY"] = 66;
+    m["MFIL"] = 67;
+
+    m[".FILL"] = 20;
+    m[".BLKW"] = 21;
+    m[".STRINGZ"] = 22;
+    m[".ORIG"] = 23;
+    m[".END"] = 24;
+    m["~SKIP"] = 25;
+    return m;
+}
+
+const std::map<std::string, word>& Assembler::mnemonics()
+{
+    static const std::map<std::string, word> m = make_mnemonics();     //shared by all simulators
+    return m;
+}
+
+word Assembler::lookup(const std::string& s)
+{
+    std::map<std::string, word>::const_iterator it = mnemonics().find(s);
+    if(it == mnemonics().end() || (it->second >= 60 && it->second <= 67 && !extensions))
+        return 0;
+    return it->second;
+}
+
+bool debug_map::save(const std::string& filename) const
+{
+    std::ofstream f(filename);
+    f << "lc3 debug 1" << std::endl << "source " << source << std::endl;
+    for(size_t i = 0; i < lines.size(); i++)
+        f << Simulator::str_fulhex(lines[i].addr) << " " << lines[i].line << " " << lines[i].size << " "
+          << (lines[i].branch ? "branch" : lines[i].code ? "code" : "data") << std::endl;
+    return (bool)f;
+}
+
+bool debug_map::load(const std::string& filename)
+{
+    std::ifstream f(filename);
+    std::string s;
+    if(!std::getline(f, s) || s != "lc3 debug 1" || !std::getline(f, s) || s.compare(0, 7, "source ") != 0)
+        return false;
+    source = s.substr(7);
+    lines.clear();
+    while(std::getline(f, s))
+    {
+        std::stringstream strm(s);
+        std::string a, kind;
+        source_line l;
+        if(!(strm >> a >> l.line >> l.size >> kind))
+            continue;
+        try
+        {
+            l.addr = Simulator::to_word(a);
+        }
+        catch(int ex)
+        {
+            return false;
+        }
+        l.code = kind != "data";
+        l.branch = kind == "branch";
+        lines.push_back(l);
+    }
+    return true;
+}
+
+std::string debug_map::filename_of(const std::string& bin)
+{
+    size_t dot = bin.rfind('.'), slash = bin.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return bin + ".dbg";
+    return bin.substr(0, dot) + ".dbg";
+}
+
+void Assembler::assembler(std::string filename, std::string ofilename)
+{
+    std::vector<word> bin;
+    debug_map map;
+    if(!assemble(filename, bin, &map))
+        return;
+    std::ofstream ofile(ofilename);
+    message << "Written to file. \""<< ofilename <<"\"" << std::endl;
+    for(int i = 0;i<(int)bin.size(); i++)
+    {
+        ofile << Simulator::word_to_bin(bin[i]) << std::endl;
+    }
+    ofile.close();
+    if(!map.save(debug_map::filename_of(ofilename)))
+        message << "Cannot write the debug map \"" << debug_map::filename_of(ofilename) << "\"" << std::endl;
+    message << "Done." <<std::endl;
+}
+
+bool Assembler::assemble(std::string filename, std::vector<word>& bin, debug_map* map)
+{
+    std::ifstream f(filename.c_str());
+
+    if(!f.is_open())
+    {
+        message << "File error when opening \"" << filename << "\""<< std::endl;
+        return false;
+    }
+
+    int errnum = 0;
+
+    int line_n = 0;
+
+    std::map<std::string, word> symmap;
+    std::vector<std::string> syms;
+    std::vector<int> symloc;
+
+    char buf[256];
+    std::vector<std::string> lines;
+    std::vector<int> line_c;
+
+    std::string s;
+
+    std::vector<std::string> ps;
+    word nzp;
+    word pcoffset,imm;
+    word r1, r2, r3;
+
+    std::string ss;
+    std::vector<word> instr;
+    std::vector<std::string> params;
+    std::vector<word> addr;
+
+    word caddr, temp;
+    int instr_n;
+    bool endedflag = false;
+    bin.clear();
+    // input from file
+    message << "Reading from" << "\""<< filename << "\"..."<< std::endl;
+    while(1)
+    {
+        f.getline(buf, 256);
+        if(f.fail())
+        {
+            message << "Error at line " << line_n<< ": Too long in a line." <<std::endl;
+        }
+
+        int ln = 0;
+
+        while(buf[ln]!='\0'&&buf[ln]!=';')
+            ln++;
+        buf[ln] = '\0';
+        s = buf;
+        s = Simulator::trim_space(s);
+
+        if(s!="")
+        {
+            lines.push_back(s);
+            line_c.push_back(line_n);
+        }
+        line_n++;
+        if(f.eof())
+            break;
+    }
+    f.close();
+    message << " Reading done"<< std::endl;
+
+
+    // check instruction
+    for(int i = 0; i<(int)lines.size(); i++)
+    {
+        ss = lines[i].c_str();
+        s = split_first(ss);
+        if(lookup(s)==0)
+        {
+            syms.push_back(s);
+            symloc.push_back(i);
+            if(ss=="")
+            {
+                s = "~SKIP";
+            }
+            else
+            {
+                s = split_first(ss);
+                if(lookup(s)==0)
+                {
+                    message << "Error at line " << line_c[i] << ": Unrecoginized instruction \"" << s << "\""<<std::endl;
+                    errnum ++;
+                }
+            }
+        }
+        instr.push_back(lookup(s));
+        params.push_back(ss);
+    }
+
+    //assign address
+    if(instr[0]!=23)
+    {
+        message << "Error at line " << line_c[0] << ": Expected \".ORIG\" "<< std::endl;
+        errnum++;
+        goto Abort;
+    }
+    else
+    {
+        try
+        {
+            caddr = Simulator::to_word(params[0]);
+        }
+        catch(int ex)
+        {
+            message << "Error at line " << line_c[0] << ": Unrecoginized syntax" << params[0] <<std::endl;
+            errnum++;
+            goto Abort;
+        }
+    }
+    bin.push_back(caddr);
+    addr.push_back(caddr);              //addr[i] is the address of lines[i]
+    instr_n = instr.size();
+    for(int i = 1; i<instr_n; i++)
+    {
+        addr.push_back(caddr);
+        switch(instr[i])
+        {
+        case 21:        // .BLKW
+            try
+            {
+                temp = Simulator::to_word(params[i]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecoginized instruction \"" << s << "\""<<std::endl;
+                errnum ++;
+            }
+            caddr += temp;
+            break;
+        case 22:        // .STRINGZ
+            s = Simulator::trim_space(params[i]);
+            if(s.length()>=2&&s[0]=='"'&&s[s.length()-1]=='"')
+            {
+                caddr += s.length()-1;      //the characters and the terminating zero
+            }
+            else
+            {
+                message << "Error at line " << line_c[i] << ":  Expected string constant, but \"" << s << "\" found instead." << std::endl;
+                errnum++;
+            }
+            break;
+        case 25:        // ~SKIP
+
+            break;
+        case 24:        // .END
+            instr_n = i;
+            if(instr_n < (int)lines.size()-1)
+            {
+                message << "Warning at line " << line_c[i] << ": The following code after .END is ignored." << std::endl;
+            }
+            endedflag = true;
+            break;
+        case 23:        // .ORIG
+            message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+            errnum++;
+            goto Abort;
+            break;
+        default:
+            caddr += 1;
+        }
+    }
+
+    if(!endedflag)
+    {
+        message << "Error at line " << line_c[instr_n-1] << ": Expected .END before end of file." << std::endl;
+        errnum++;
+        goto Abort;
+
+    }
+
+    for(int i = 0; i < (int)syms.size(); i++)
+    {
+        if(symmap.find(syms[i])==symmap.end())
+        {
+            symmap[syms[i]] = addr[symloc[i]];
+        }
+        else
+        {
+            message << "Error at line " << symloc[i] << ": A label was defined more than once." << std::endl;
+            goto Abort;
+            errnum++;
+        }
+    }
+
+    //assemble
+    for(int i = 1; i < instr_n; i++)
+    {
+        switch(instr[i])
+        {
+        case 30:        //BR
+        case 31:
+        case 32:
+        case 33:
+        case 34:
+        case 35:
+        case 36:
+        case 37:
+            nzp = instr[i]-30;
+            try
+            {
+                pcoffset = symmap.find(params[i])!=symmap.end()?(symmap[params[i]]-addr[i]-1):(Simulator::to_word(params[i]));
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            if(check_number(pcoffset, 9))
+                bin.push_back(0+(nzp<<9)+Simulator::slice(pcoffset, 0, 9));
+            else
+            {
+                add_overflow_err(line_c[i], 9);
+                errnum++;
+            }
+            break;
+        case 1:         //AND ADD
+        case 5:
+            ps = split(params[i]);
+            if(ps.size()!=3)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 3 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+                break;
+            }
+            r1 = to_reg(ps[0]);
+            r2 = to_reg(ps[1]);
+            r3 = to_reg(ps[2]);
+            if(r1<=7&&r2<=7)
+            {
+                if(r3<=7)
+                {
+                    bin.push_back((instr[i]<< 12) + (r1<<9)+ (r2<<6) + r3);
+                }
+                else
+                {
+                    try
+                    {
+                        imm = Simulator::to_word(ps[2]);
+                    }
+                    catch(int ex)
+                    {
+                        message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                        errnum++;
+                    }
+                    if(check_number(imm, 5))
+                    {
+                        bin.push_back((instr[i]<<12) + (r1<<9)+ (r2<<6)+ (1<<5) + Simulator::slice(imm, 0, 5));
+                    }
+                    else
+                    {
+                        add_overflow_err(line_c[i], 5);
+                    }
+                }
+            }
+            else
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            break;
+        case 2:         //LD ST LEA LDI STI
+        case 3:
+        case 14:
+        case 10:
+        case 11:
+            ps = split(params[i]);
+            if(ps.size()!=2)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 2 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+                break;
+            }
+            r1 = to_reg(ps[0]);
+            if(r1>7)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            try
+            {
+                pcoffset = symmap.find(ps[1])!=symmap.end()?symmap[ps[1]]-addr[i]-1:Simulator::to_word(ps[1]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            if(check_number(pcoffset, 9))
+                bin.push_back((instr[i]<<12)+(r1<<9)+Simulator::slice(pcoffset, 0, 9));
+            else
+            {
+                add_overflow_err(line_c[i], 9);
+                errnum++;
+            }
+            break;
+
+        case 6:         //LDR STR
+        case 7:
+            ps = split(params[i]);
+            if(ps.size()!=3)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 3 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+                break;
+            }
+            r1 = to_reg(ps[0]);
+            r2 = to_reg(ps[1]);
+            if(r1>7||r2>7)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            try
+            {
+                pcoffset = symmap.find(ps[2])!=symmap.end()?symmap[ps[2]]-addr[i]-1:Simulator::to_word(ps[2]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            if(check_number(pcoffset, 6))
+                bin.push_back((instr[i]<<12)+(r1<<9) + (r2<<6) + Simulator::slice(pcoffset, 0, 6));
+            else
+            {
+                add_overflow_err(line_c[i], 6);
+                errnum++;
+            }
+            break;
+
+        case 9:         //NOT
+            ps = split(params[i]);
+            if(ps.size()!=2)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 2 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+                goto Abort;
+            }
+            r1 = to_reg(ps[0]);
+            r2 = to_reg(ps[1]);
+            if(r1>7||r2>7)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+                goto Abort;
+            }
+            bin.push_back((instr[i]<<12) + (r1<<9)+(r2<<6)+((1<<6)-1));
+            break;
+        case 8:         //RTI
+            bin.push_back(instr[i]<<12);
+            break;
+        case 12:        //RET
+            bin.push_back((instr[i]<<12) + (7<<6));
+            break;
+        case 4:         //JSR
+            try
+            {
+                pcoffset = symmap.find(params[i])!=symmap.end()?(symmap[params[i]]-addr[i]-1):(Simulator::to_word(params[i]));
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+                break;
+            }
+            if(check_number(pcoffset, 11))
+                bin.push_back((4<<12) + (1<<11) + Simulator::slice(pcoffset, 0, 11));
+            else
+            {
+                add_overflow_err(line_c[i], 11);
+                errnum++;
+            }
+            break;
+        case 40:        //JSRR JMP
+        case 41:
+            r1 = to_reg(Simulator::trim_space(params[i]));
+            if(r1>7)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+                break;
+            }
+            bin.push_back(((instr[i]==40?4:12)<<12) + (r1<<6));
+            break;
+        case 50:        //GETC OUT PUTS IN PUTSP HALT
+        case 51:
+        case 52:
+        case 53:
+        case 54:
+        case 55:
+            bin.push_back(0xf020 + instr[i]-50);
+            break;
+        case 60:        //MUL DIV MOD SHL SHR SRA MCPY MFIL
+        case 61:
+        case 62:
+        case 63:
+        case 64:
+        case 65:
+        case 66:
+        case 67:
+            ps = split(params[i]);
+            if(ps.size()!=3)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 3 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+                break;
+            }
+            r1 = to_reg(ps[0]);
+            r2 = to_reg(ps[1]);
+            r3 = to_reg(ps[2]);
+            if(r1>7||r2>7||r3>7)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+                break;
+            }
+            bin.push_back((13<<12) + (r1<<9) + (r2<<6) + ((instr[i]-60)<<3) + r3);
+            break;
+        case 15:        //TRAP
+            ps = split(params[i]);
+            if(ps.size()!=1)
+            {
+                message << "Error at line " << line_c[i] << ": Expected 1 parameters but " << ps.size() << " found" << std::endl;
+                errnum++;
+            }
+            try
+            {
+                imm = Simulator::to_word(ps[0]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            if(!check_number(imm, 8))
+            {
+                add_overflow_err(line_c[i], 8);
+            }
+            bin.push_back((instr[i]<<12) + Simulator::slice(imm,0,8));
+            break;
+        case 20:        //.FILL
+            try
+            {
+                imm = Simulator::to_word(params[i]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            bin.push_back(imm);
+            break;
+        case 21:        //.BLKW
+            try
+            {
+                imm = Simulator::to_word(params[i]);
+            }
+            catch(int ex)
+            {
+                message << "Error at line " << line_c[i] << ": Unrecognized syntax" << std::endl;
+                errnum++;
+            }
+            for(int j = 0;j<imm;j++)
+            {
+                bin.push_back(0);
+            }
+            break;
+        case 22:        //.STRINGZ
+            for(int j =1;j<(int)params[i].size()-1;j++)
+            {
+                bin.push_back(params[i][j]);
+            }
+            bin.push_back(0);
+            break;
+        case 25:        //~SKIP
+
+            break;
+        }
+
+    }
+
+    //the words of each line, for the debug map
+    if(map != NULL && errnum == 0)
+    {
+        map->source = filename;
+        map->lines.clear();
+        for(int i = 1; i < instr_n; i++)
+        {
+            source_line l;
+            l.addr = addr[i];
+            l.size = addr[i+1] - addr[i];
+            l.line = line_c[i] + 1;
+            l.code = instr[i] != 20 && instr[i] != 21 && instr[i] != 22;
+            word h = bin[1 + (word)(addr[i] - addr[0])];
+            l.branch = l.code && h>>12 == 0 && Simulator::slice(h, 9, 12) != 0 && Simulator::slice(h, 9, 12) != 7;
+            if(l.size > 0)
+                map->lines.push_back(l);
+        }
+    }
+    Abort:
+
+    if(errnum == 0)
+    {
+        message << "Done. " << errnum << " error(s)" <<std::endl;
+        return true;
+    }
+    else
+    {
+        message << "Failed. " << errnum << " error(s)" <<std::endl;
+        return false;
+    }
+}
+
+word Assembler::to_reg(std::string s)
+{
+    if(s.size()==2 && s[0]=='R')
+    {
+        if(0<=s[1]-'0' && s[1]-'0'<=7)
+            return s[1]-'0';
+    }
+    return 99;
+}
+
+bool Assembler::check_number(word x, int n)
+{
+    if(Simulator::bit(x, 15))
+        x = (~x)+1;
+    return x<(1<<n);
+}
+
+std::vector<std::string> Assembler::split(std::string str)
+{
+    std::vector<std::string> ret;
+    size_t n = 0, nn;
+    while(1)
+    {
+        nn = str.find(',', n);
+        if(nn==str.npos)
+            break;
+        ret.push_back(Simulator::trim_space(str.substr(n, nn-n)));
+        n = nn+1;
+    }
+    ret.push_back(Simulator::trim_space(str.substr(n, str.size()-n)));
+    return ret;
+}
+
+std::string Assembler::split_first(std::string& str)
+{
+    std::string ret;
+    size_t nn;
+    str = Simulator::trim_space(str);
+    nn = std::min(str.find('\t', 0),str.find(' ', 0));
+    if(nn!=str.npos)
+    {
+        ret = Simulator::trim_space(str.substr(0, nn));
+        str = Simulator::trim_space(str.substr(nn+1, str.size()-nn-1));
+    }
+    else
+    {
+        ret = str;
+        str = "";
+    }
+    return ret;
+}
+void Assembler::add_overflow_err(int line, int bitn)
+{
+    message << "Error at line " << line << ": Cannot represent in "<< bitn << "bit number" << std::endl;
+}
@@ -0,0 +1,57 @@
+#ifndef ASSEMBLER_H_INCLUDED
+#define ASSEMBLER_H_INCLUDED
+
+#include "sim.h"
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//the source line of the words at addr, kept by the assembler for coverage reports
+struct source_line
+{
+    word addr;
+    word size;                          //words it assembled to
+    int line;                           //in the source, from 1
+    bool code;                          //an instruction; else .FILL, .BLKW or .STRINGZ data
+    bool branch;                        //a BR that may or may not be taken
+};
+
+/*
+    The line/address debug map of an image. Assembling to a .bin file writes it next to
+    it, as .dbg: a header "lc3 debug 1", "source" and the source file name, then a line
+    "address line size code|branch|data" for each line that assembled to words.
+*/
+struct debug_map
+{
+    std::string source;                 //the file assembled, as it was named
+    std::vector<source_line> lines;     //by address
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+    static std::string filename_of(const std::string& bin);    //the .dbg of a .bin
+};
+
+//the LC-3 assembler. It keeps no state between files; errors are written to message.
+class Assembler
+{
+public:
+    std::ostream& message;
+    bool extensions = false;            //accept the mnemonics of the 1101 extension ops; they are plain labels otherwise
+
+    Assembler(std::ostream& msg): message(msg) {}
+
+    static const std::map<std::string, word>& mnemonics();     //mnemonic or directive -> instruction code
+    word lookup(const std::string& s);  //the instruction code of s, 0 if it is not a mnemonic here
+
+    void assembler(std::string filename, std::string ofilename);    //assemble into an .bin file and its .dbg
+    bool assemble(std::string filename, std::vector<word>& bin, debug_map* map = NULL);   //assemble into an image: the origin followed by the words
+
+    void add_overflow_err(int line, int bitn);
+    std::vector<std::string> split(std::string str);
+    std::string split_first(std::string& str);
+    bool check_number(word x, int n);
+    word to_reg(std::string s);
+};
+
+#endif // ASSEMBLER_H_INCLUDED
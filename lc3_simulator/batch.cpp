@@ -0,0 +1,659 @@
+#include "batch.h"
+#include "assembler.h"
+#include "cache.h"
+#include "cfg.h"
+#include "coverage.h"
+#include "decode.h"
+#include "diff.h"
+#include "disk.h"
+#include "framebuffer.h"
+#include "fuzz.h"
+#include "server.h"
+#include "smp.h"
+#include "timing.h"
+#include "translate.h"
+#include "sim.h"
+#include "terminal.h"
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static void batch_usage()
+{
+    fprintf(stderr,
+        "usage: lc3_simulator [options]\n"
+        "  --load prog.bin     load a .bin image (repeatable); PC starts at the first origin\n"
+        "  --asm prog.asm      assemble a source file and load it (repeatable)\n"
+        "  --ext               enable the 1101 extension ops (MUL, DIV, MOD, SHL, SHR, SRA, MCPY, MFIL)\n"
+        "  --os image.bin      use this OS image instead of the built-in one\n"
+        "  --input in.txt      keyboard input of the program\n"
+        "  --record keys.log   log the keys the program is handed, with their step counts\n"
+        "  --replay keys.log   hand the program the keys of a log at the same step counts, instead of --input\n"
+        "  --max-steps N       stop after N instructions (default: no limit)\n"
+        "  --break addr        stop at a breakpoint (repeatable), e.g. x3005\n"
+        "  --pc addr           start at addr instead of the first origin\n"
+        "  --expect out.txt    compare the display output with this file\n"
+        "  --dump-regs         print the registers to stderr when the program stops\n"
+        "  --trace N           print the last N instructions to stderr when the program stops\n"
+        "  --profile N         print the N addresses executed most to stderr when the program stops\n"
+        "  --disk image        attach a block device on this image file (see disk.h)\n"
+        "  --frames pattern    save the video memory xC000-xFDFF as frames, e.g. out/f%%04d.png (or .ppm)\n"
+        "  --frame-every N     instructions between two frames (default 50000)\n"
+        "  --preview fps       draw the video memory on stderr, at most fps times per second\n"
+        "  --icache spec       simulate an instruction cache: size,line,ways[,lru|fifo] in words\n"
+        "  --dcache spec       simulate a data cache: size,line,ways[,lru|fifo][,wb|wt] in words\n"
+        "  --timing predictor  estimate pipeline cycles with this branch predictor:\n"
+        "                      nt, t, btfn, 2bit[:bits] or gshare[:bits]\n"
+        "  --pipeline spec     pipeline of --timing: forward|noforward,mem=N,branch=N,indirect=N\n"
+        "  --listing file      write the disassembly of the code reachable from PC and the vectors\n"
+        "  --dot file          write the control-flow graph of that code for Graphviz\n"
+        "  --fuzz dir          fuzz the keyboard input (--input is the seed) and save crashes and hangs in dir\n"
+        "  --fuzz-runs N       runs of --fuzz (default 100000); --max-steps is the budget of a run (default 100000)\n"
+        "  --coverage file     add the line and branch coverage of the sources run to this lcov tracefile,\n"
+        "                      which parallel runs may share; a --load image needs its .dbg, not with --smp\n"
+        "  --coverage-text file  write the sources annotated with that coverage\n"
+        "  --diff a,b          run two engines in lockstep and report the first divergence; engines: interp, probed, aot, decoded\n"
+        "  --diff-block        compare the engines at the end of basic blocks instead of every instruction\n"
+        "  --diff-random N     compare the engines on N random programs of at most 10000 steps by default\n"
+        "  --seed N            random seed of --fuzz and --diff-random (default 1)\n"
+        "  --aot               run on the translations compiled in (see translate.h), not with --smp\n"
+        "  --decode-cache file run on predecoded pages shared through this cache file (see decode.h), not with --smp\n"
+        "  --irq-stats         print the interrupts taken and their latency to stderr\n"
+        "  --smp N             run N CPUs (at most 8) on one shared memory, each on a host thread (see smp.h)\n"
+        "  --smp-rr Q          run the CPUs of --smp in turn on one thread, Q instructions each, reproducibly\n"
+        "  --metrics file      write the run metrics when the program stops: Prometheus text if file ends in .prom, JSON otherwise\n"
+        "  --serve socket      run as a grading daemon on a Unix domain socket (see server.h)\n"
+        "  --workers N         worker threads of the daemon (default: one per core)\n"
+        "exit codes: 0 halted, 1 output mismatch, 2 step budget exhausted,\n"
+        "            3 privilege exception, 4 breakpoint, 5 usage or load error\n");
+}
+
+//the framebuffer, mapped at the first option that needs it
+static FramebufferDevice* video(Simulator& sim, FramebufferDevice*& fb)
+{
+    if(fb == NULL)
+    {
+        fb = new FramebufferDevice();
+        sim.add_device(fb, FramebufferDevice::base, 0xfdff);
+        fb->reset(sim);
+    }
+    return fb;
+}
+
+static bool read_file(const char* filename, std::string& content)
+{
+    std::ifstream f(filename, std::ios::in | std::ios::binary);
+    if(!f.is_open())
+        return false;
+    std::stringstream ss;
+    ss << f.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+static bool write_file(const char* filename, const std::string& content)
+{
+    std::ofstream f(filename, std::ios::out | std::ios::binary);
+    if(!f.is_open())
+    {
+        fprintf(stderr, "cannot write %s\n", filename);
+        return false;
+    }
+    f << content;
+    return true;
+}
+
+std::string dump_regs(Simulator& sim)
+{
+    std::string s = "PC=" + sim.str_fulhex(sim.PC) + " IR=" + sim.str_fulhex(sim.IR) + " PSR=" + sim.str_fulhex(sim.PSR)
+                  + " CC=" + (sim.bit(sim.PSR, 0)?'p':(sim.bit(sim.PSR, 1)?'z':'n')) + "\n";
+    for(int i = 0; i < 8; i++)
+        s += "R" + std::to_string(i) + "=" + sim.str_fulhex(sim.gen_reg[i]) + (i == 7 ? "\n" : " ");
+    return s;
+}
+
+int batch_status(const Simulator& sim)
+{
+    switch(sim.sim_status)
+    {
+    case Simulator::Halt:
+        return Batch_Success;
+    case Simulator::Priviledge_Exception:
+        return Batch_Priviledge_Exception;
+    case Simulator::Breakpoint:
+        return Batch_Breakpoint;
+    default:
+        return Batch_Timeout;
+    }
+}
+
+//--diff: the loaded image, or random programs, in two engines
+static int run_diff(Simulator& sim, const std::string& engines, bool per_block, int random, unsigned int seed,
+                    const std::string& input, word start_pc, bool loaded, long long max_steps)
+{
+    std::string names[2] = {engines.substr(0, engines.find(',')), ""};
+    if(engines.find(',') != std::string::npos)
+        names[1] = engines.substr(engines.find(',') + 1);
+    Engine* e[2];
+    for(int k = 0; k < 2; k++)
+        if((e[k] = Engine::create(names[k])) == NULL)
+        {
+            fprintf(stderr, "unknown engine %s\n", names[k].c_str());
+            if(k == 1)
+                delete e[0];
+            return Batch_Error;
+        }
+    DiffHarness harness(e[0], e[1]);
+    harness.per_block = per_block;
+    if(random == 0 && !loaded)
+    {
+        fprintf(stderr, "nothing to run: use --load, --asm or --diff-random\n");
+        return Batch_Error;
+    }
+
+    std::mt19937 rng(seed);
+    int programs = random > 0 ? random : 1, divergences = 0;
+    long long total = 0;
+    sim.save_baseline();
+    for(int i = 0; i < programs; i++)
+    {
+        std::string report;
+        sim.fast_reset();
+        if(random > 0)
+        {
+            sim.load_words(random_program(rng, 8 + rng() % 56));
+            sim.PC = 0x3000;
+        }
+        else
+            sim.PC = start_pc;
+        harness.load(sim);
+        if(!harness.run(input, max_steps, report))
+        {
+            divergences++;
+            if(random > 0)
+                fprintf(stderr, "random program %d:\n", i);
+            fprintf(stderr, "%s", report.c_str());
+        }
+        total += harness.steps;
+    }
+    fprintf(stderr, "%s vs %s: %d program%s, %lld steps, %d divergence%s\n", names[0].c_str(), names[1].c_str(),
+            programs, programs == 1 ? "" : "s", total, divergences, divergences == 1 ? "" : "s");
+    return divergences ? Batch_Mismatch : Batch_Success;
+}
+
+bool is_batch_args(int argc, char* argv[])
+{
+    return argc > 1 && strncmp(argv[1], "--", 2) == 0;
+}
+
+int run_batch(int argc, char* argv[])
+{
+    std::unique_ptr<Simulator> simp(new Simulator());      //too large for the stack of a worker thread
+    Simulator& sim = *simp;
+    BufferTerminal term;
+    std::string expect;
+    bool has_expect = false, dump = false, irq_stats = false, has_pc = false, loaded = false;
+    long long max_steps = -1;
+    std::string serve_path;
+    int workers = 0, trace = 0, profile = 0, cpus = 0, quantum = 0;
+    word start_pc = 0x3000;
+    FramebufferDevice* fb = NULL;
+    std::unique_ptr<CacheProbe> caches;
+    std::unique_ptr<TimingProbe> timing;
+    std::unique_ptr<SourceCoverage> coverage;
+    std::vector<debug_map> maps;        //of the images loaded
+    std::vector<std::string> unmapped;  //images loaded without one
+    std::string predictor, listing_path, dot_path, metrics_path, decode_path, coverage_path, coverage_text;
+    pipeline_config pipeline;
+    fuzz_config fuzzing;
+    bool fuzz = false, diff_block = false, aot = false;
+    std::string diff_engines;
+    int diff_random = 0;
+    unsigned int seed = 1;
+    int ret;
+
+    sim.initialize();
+    sim.term = &term;
+    for(int i = 1; i < argc; i++)
+        if(strcmp(argv[i], "--ext") == 0)
+            sim.extensions = true;              //before any --asm, wherever it is given
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string opt = argv[i];
+        const char* val = i+1 < argc ? argv[i+1] : NULL;
+        if(opt == "--dump-regs")
+        {
+            dump = true;
+            continue;
+        }
+        if(opt == "--ext")
+            continue;
+        if(opt == "--diff-block")
+        {
+            diff_block = true;
+            continue;
+        }
+        if(opt == "--irq-stats")
+        {
+            irq_stats = true;
+            continue;
+        }
+        if(opt == "--aot")
+        {
+            aot = true;
+            continue;
+        }
+        if(opt == "--help" || opt == "-h")
+        {
+            batch_usage();
+            return Batch_Error;
+        }
+        if(val == NULL)
+        {
+            fprintf(stderr, "missing value of %s\n", opt.c_str());
+            batch_usage();
+            return Batch_Error;
+        }
+        i++;
+        try
+        {
+            if(opt == "--load" || opt == "--asm")
+            {
+                std::vector<word> bin;
+                debug_map map;
+                bool ok;
+                if(opt == "--load")
+                    ok = sim.load_bin(val);
+                else
+                    ok = sim.assemble(val, bin, &map) && sim.load_words(bin);
+                if(!ok)
+                {
+                    fprintf(stderr, "%s", sim.message().str().c_str());
+                    return Batch_Error;
+                }
+                if(opt == "--asm" || map.load(debug_map::filename_of(val)))
+                    maps.push_back(map);
+                else
+                    unmapped.push_back(val);
+                if(!loaded && !has_pc)
+                    start_pc = sim.load_origin;
+                loaded = true;
+            }
+            else if(opt == "--os")
+            {
+                if(!sim.load_os(val))
+                {
+                    fprintf(stderr, "cannot open \"%s\"\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--input")
+            {
+                if(!read_file(val, term.input))
+                {
+                    fprintf(stderr, "cannot open \"%s\"\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--expect")
+            {
+                if(!read_file(val, expect))
+                {
+                    fprintf(stderr, "cannot open \"%s\"\n", val);
+                    return Batch_Error;
+                }
+                has_expect = true;
+            }
+            else if(opt == "--max-steps")
+            {
+                max_steps = atoll(val);
+            }
+            else if(opt == "--break")
+            {
+                sim.set_bk(sim.to_word(val));
+            }
+            else if(opt == "--serve")
+            {
+                serve_path = val;
+            }
+            else if(opt == "--workers")
+            {
+                workers = atoi(val);
+            }
+            else if(opt == "--disk")
+            {
+                BlockDevice* disk = new BlockDevice(sim, val);
+                sim.add_device(disk, BlockDevice::BDSR, BlockDevice::BDCT + 1);
+                if(!disk->ok())
+                {
+                    fprintf(stderr, "cannot open \"%s\"\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--frames")
+            {
+                std::string name;
+                if(!FramebufferDevice::frame_name(val, 0, name))
+                {
+                    fprintf(stderr, "--frames needs one %%d, %%0Nd or %%Nd for the frame number\n");
+                    return Batch_Error;
+                }
+                video(sim, fb)->pattern = val;
+            }
+            else if(opt == "--frame-every")
+            {
+                video(sim, fb)->frame_cycles = std::max(1LL, atoll(val));
+            }
+            else if(opt == "--preview")
+            {
+                video(sim, fb)->preview = stderr;
+                fb->preview_fps = atof(val);
+            }
+            else if(opt == "--icache" || opt == "--dcache")
+            {
+                cache_config cfg;
+                if(!cfg.parse(val))
+                {
+                    fprintf(stderr, "bad cache %s\n", val);
+                    return Batch_Error;
+                }
+                if(!caches)
+                {
+                    caches.reset(new CacheProbe());
+                    sim.add_probe(caches.get());
+                }
+                (opt == "--icache" ? caches->icache : caches->dcache).configure(cfg);
+            }
+            else if(opt == "--timing")
+            {
+                predictor = val;
+            }
+            else if(opt == "--pipeline")
+            {
+                if(!pipeline.parse(val))
+                {
+                    fprintf(stderr, "bad pipeline %s\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--listing")
+            {
+                listing_path = val;
+            }
+            else if(opt == "--dot")
+            {
+                dot_path = val;
+            }
+            else if(opt == "--trace")
+            {
+                trace = atoi(val);
+                sim.set_trace(trace);
+            }
+            else if(opt == "--profile")
+            {
+                profile = atoi(val);
+                sim.set_profile(true);
+            }
+            else if(opt == "--smp")
+            {
+                cpus = atoi(val);
+                if(cpus < 1 || cpus > 8)
+                {
+                    fprintf(stderr, "--smp takes 1 to 8 CPUs\n");
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--smp-rr")
+            {
+                quantum = std::max(1, atoi(val));
+            }
+            else if(opt == "--decode-cache")
+            {
+                decode_path = val;
+            }
+            else if(opt == "--record")
+            {
+                if(!sim.keyboard->start_record(sim, val))
+                {
+                    fprintf(stderr, "cannot write %s\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--replay")
+            {
+                if(!sim.keyboard->start_replay(sim, val))
+                {
+                    fprintf(stderr, "cannot read the key log %s\n", val);
+                    return Batch_Error;
+                }
+            }
+            else if(opt == "--metrics")
+            {
+                metrics_path = val;
+            }
+            else if(opt == "--fuzz")
+            {
+                fuzzing.out_dir = val;
+                fuzz = true;
+            }
+            else if(opt == "--fuzz-runs")
+            {
+                fuzzing.runs = atoll(val);
+            }
+            else if(opt == "--seed")
+            {
+                seed = strtoul(val, NULL, 10);
+            }
+            else if(opt == "--coverage")
+            {
+                coverage_path = val;
+            }
+            else if(opt == "--coverage-text")
+            {
+                coverage_text = val;
+            }
+            else if(opt == "--diff")
+            {
+                diff_engines = val;
+            }
+            else if(opt == "--diff-random")
+            {
+                diff_random = atoi(val);
+            }
+            else if(opt == "--pc")
+            {
+                start_pc = sim.to_word(val);
+                has_pc = true;
+            }
+            else
+            {
+                fprintf(stderr, "unknown option %s\n", opt.c_str());
+                batch_usage();
+                return Batch_Error;
+            }
+        }
+        catch(int ex)
+        {
+            fprintf(stderr, "cannot recognize %s\n", val);
+            return Batch_Error;
+        }
+    }
+    if(!serve_path.empty())
+        return run_server(serve_path, workers, max_steps >= 0 ? max_steps : 100000000);
+    if(!diff_engines.empty())
+        return run_diff(sim, diff_engines, diff_block, diff_random, seed, term.input, has_pc ? start_pc : sim.PC,
+                        loaded, max_steps >= 0 ? max_steps : diff_random > 0 ? 10000 : 100000);
+    if(!loaded && !coverage_path.empty() && !coverage_text.empty())
+    {
+        //the report of the runs so far
+        CoverageReport report;
+        std::string info;
+        if(!read_file(coverage_path.c_str(), info) || !report.parse(info))
+        {
+            fprintf(stderr, "cannot read the tracefile %s\n", coverage_path.c_str());
+            return Batch_Error;
+        }
+        return write_file(coverage_text.c_str(), report.text()) ? Batch_Success : Batch_Error;
+    }
+    if(!loaded)
+    {
+        fprintf(stderr, "nothing to run: use --load or --asm\n");
+        return Batch_Error;
+    }
+    if(cpus > 0 && (aot || !decode_path.empty()))
+    {
+        fprintf(stderr, "%s is not supported with --smp\n", aot ? "--aot" : "--decode-cache");
+        return Batch_Error;
+    }
+    if(!coverage_path.empty() || !coverage_text.empty())
+    {
+        if(cpus > 0)
+        {
+            fprintf(stderr, "--coverage is not supported with --smp\n");
+            return Batch_Error;
+        }
+        for(size_t i = 0; i < unmapped.size(); i++)
+            fprintf(stderr, "no debug map %s; the code of %s is not covered\n",
+                    debug_map::filename_of(unmapped[i]).c_str(), unmapped[i].c_str());
+        coverage.reset(new SourceCoverage());
+        sim.add_probe(coverage.get());
+    }
+
+    if(!predictor.empty())
+    {
+        BranchPredictor* p = BranchPredictor::create(predictor);
+        if(p == NULL)
+        {
+            fprintf(stderr, "unknown branch predictor %s\n", predictor.c_str());
+            return Batch_Error;
+        }
+        timing.reset(new TimingProbe(pipeline, p));
+        sim.add_probe(timing.get());
+    }
+
+    sim.PC = start_pc;
+    if(!listing_path.empty() || !dot_path.empty())
+    {
+        ControlFlowGraph cfg;
+        cfg.analyze(sim, ControlFlowGraph::default_entries(sim));
+        if(!listing_path.empty() && !write_file(listing_path.c_str(), cfg.listing(sim)))
+            return Batch_Error;
+        if(!dot_path.empty() && !write_file(dot_path.c_str(), cfg.dot(sim)))
+            return Batch_Error;
+    }
+    if(fuzz)
+    {
+        if(max_steps >= 0)
+            fuzzing.max_steps = max_steps;
+        fuzzing.seed = seed;
+        sim.save_baseline();
+        Fuzzer fuzzer(sim, term, fuzzing);
+        std::vector<std::string> seeds;
+        if(!term.input.empty())
+            seeds.push_back(term.input);
+        fuzzer.fuzz(seeds);
+        fprintf(stderr, "%s", fuzzer.report().c_str());
+        return Batch_Success;
+    }
+    std::unique_ptr<SmpSystem> smp;
+    std::unique_ptr<TranslatedRunner> runner;
+    DecodeCache decode_cache;
+    if(cpus > 0)
+    {
+        smp.reset(new SmpSystem(sim, cpus));
+        smp->start(start_pc);
+        if(quantum > 0)
+            smp->run_round_robin(max_steps < 0 ? LLONG_MAX : max_steps, quantum);
+        else
+            smp->run(max_steps < 0 ? LLONG_MAX : max_steps);
+    }
+    else
+    {
+        if(aot || !decode_path.empty())
+        {
+            runner.reset(new TranslatedRunner(sim));
+            if(aot)
+                runner->attach();
+            if(!decode_path.empty())
+            {
+                if(!decode_cache.open(decode_path))
+                    fprintf(stderr, "cannot map %s; pages are decoded for this run only\n", decode_path.c_str());
+                runner->cache = &decode_cache;
+            }
+        }
+        long long budget = max_steps < 0 ? LLONG_MAX : max_steps;
+        do
+        {
+            if(runner)
+                runner->run(budget - (long long)sim.cycle);
+            else
+                sim.run(budget - (long long)sim.cycle);
+        }
+        //a replayed ESC stops the run where it stopped the console session, which went on
+        while(sim.sim_status == Simulator::User_Interrupt && (long long)sim.cycle < budget);
+    }
+    if(fb != NULL)
+        fb->flush(sim);
+
+    fwrite(term.output.data(), 1, term.output.size(), stdout);
+    fflush(stdout);
+
+    ret = batch_status(sim);
+    if(ret == Batch_Success && has_expect && term.output != expect)
+        ret = Batch_Mismatch;
+    if(dump)
+    {
+        fprintf(stderr, "status=%d instructions=%llu\n", ret, sim.HistoryCount);
+        fprintf(stderr, "%s", dump_regs(sim).c_str());
+        if(smp)
+        {
+            for(size_t i = 1; i < smp->cpus.size(); i++)
+                fprintf(stderr, "cpu %d:\n%s", (int)i, dump_regs(*smp->cpus[i]).c_str());
+            fprintf(stderr, "%s", smp->report().c_str());
+        }
+        if(runner)
+            fprintf(stderr, "%s", runner->report().c_str());
+    }
+    if(trace > 0)
+        fprintf(stderr, "last instructions:\n%s", sim.trace_report(trace).c_str());
+    if(profile > 0)
+        fprintf(stderr, "executed most:\n%s", sim.profile_report(profile).c_str());
+    if(timing)
+        fprintf(stderr, "%s", timing->report(sim).c_str());
+    if(caches)
+        fprintf(stderr, "%s", caches->report().c_str());
+    if(irq_stats)
+        fprintf(stderr, "%s", sim.irq_report().c_str());
+    if(coverage)
+    {
+        CoverageReport report;
+        for(size_t i = 0; i < maps.size(); i++)
+            report.add(maps[i], *coverage);
+        if(!coverage_path.empty() && !report.merge_file(coverage_path))
+        {
+            fprintf(stderr, "cannot merge the coverage into %s\n", coverage_path.c_str());
+            return Batch_Error;
+        }
+        if(!coverage_text.empty() && !write_file(coverage_text.c_str(), report.text()))
+            return Batch_Error;
+    }
+    if(!metrics_path.empty())
+    {
+        MetricsRegistry registry;
+        registry.collect(sim);
+        if(!registry.save(metrics_path))
+        {
+            fprintf(stderr, "cannot write %s\n", metrics_path.c_str());
+            return Batch_Error;
+        }
+    }
+    return ret;
+}
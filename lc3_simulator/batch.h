@@ -0,0 +1,24 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include <string>
+
+//exit codes of the command-line batch mode
+enum batch_exit_code
+{
+    Batch_Success = 0,              //halted (and the output matched --expect)
+    Batch_Mismatch = 1,             //halted, but the output differs from --expect
+    Batch_Timeout = 2,              //the --max-steps budget ran out
+    Batch_Priviledge_Exception = 3, //RTI in user mode
+    Batch_Breakpoint = 4,           //stopped at a --break address
+    Batch_Error = 5                 //bad arguments or a file that failed to load
+};
+
+class Simulator;
+
+int batch_status(const Simulator& sim);         //the batch_exit_code of a stopped simulator, not comparing any output
+std::string dump_regs(Simulator& sim);          //"PC=x3000 IR=... R7=x0000"
+bool is_batch_args(int argc, char* argv[]);     //are these command-line options of the batch mode
+int run_batch(int argc, char* argv[]);          //run a program without any console and return its batch_exit_code
+
+#endif // BATCH_H_INCLUDED
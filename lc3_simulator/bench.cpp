@@ -0,0 +1,330 @@
+/*
+    Throughput benchmark: lc3bench [--dir path] [--mode interp|probed|aot|decoded|all] [--repeat N]
+                                   [--random N] [--seed N] [--only name]
+
+    Runs the workloads of bench/ and a set of seeded random programs in each execution
+    mode and prints one JSON object on stdout: per workload and mode the instructions run,
+    the best time of --repeat runs as MIPS and ns per instruction, the heap allocations
+    made by a run, and the times to assemble and load the image.
+*/
+#include "decode.h"
+#include "diff.h"
+#include "sim.h"
+#include "terminal.h"
+#include "translate.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#endif // _WIN32
+
+#ifndef LC3_BENCH_DIR
+#define LC3_BENCH_DIR "bench"
+#endif
+
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t n)
+{
+    allocations++;
+    void* p = malloc(n ? n : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+//Simulator is over-aligned, so new Simulator() comes here
+void* operator new(size_t n, std::align_val_t al)
+{
+    allocations++;
+    void* p = NULL;
+#ifndef _WIN32
+    if(posix_memalign(&p, std::max<size_t>((size_t)al, sizeof(void*)), n ? n : 1) != 0)
+        p = NULL;
+#else
+    p = _aligned_malloc(n ? n : 1, (size_t)al);
+#endif // _WIN32
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifndef _WIN32
+    free(p);
+#else
+    _aligned_free(p);
+#endif // _WIN32
+}
+
+void operator delete(void* p, size_t, std::align_val_t al) noexcept
+{
+    operator delete(p, al);
+}
+
+void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void* operator new[](size_t n, std::align_val_t al)
+{
+    return operator new(n, al);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, std::align_val_t al) noexcept
+{
+    operator delete(p, al);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t al) noexcept
+{
+    operator delete(p, al);
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ms_since(bench_clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - t).count();
+}
+
+struct workload
+{
+    const char* name;
+    const char* file;           //in the bench directory; NULL for the random programs
+    int input;                  //keys of keyboard input
+    bool ext;                   //uses the 1101 extension ops
+};
+
+static const workload workloads[] =
+{
+    {"sort", "sort.asm", 0, false},                     //insertion sort, loads and stores
+    {"strings", "strings.asm", 0, false},               //string routines called by JSR
+    {"recurse", "recurse.asm", 0, false},               //recursive calls with a stack
+    {"interrupts", "interrupts.asm", 3000, false},      //timer and keyboard interrupts
+    {"output", "output.asm", 0, false},                 //PUTS and OUT through the OS
+    {"multiply", "multiply.asm", 0, false},             //software multiply and block copy
+    {"multiply_ext", "multiply_ext.asm", 0, true},      //the same with MUL and MCPY
+    {"random", NULL, 0, false},
+};
+
+struct result
+{
+    std::string name, mode, status;
+    long long instructions = 0;
+    double best_ms = 0, assemble_ms = 0, load_ms = 0;
+    unsigned long long allocs = 0;
+};
+
+static const char* status_name(const Simulator& sim)
+{
+    switch(sim.sim_status)
+    {
+    case Simulator::Halt:
+        return "halt";
+    case Simulator::Normal:
+        return "steps";
+    case Simulator::Priviledge_Exception:
+        return "privilege";
+    default:
+        return "stopped";
+    }
+}
+
+//one run from the baseline, on the translations if runner is not NULL: instructions and time
+static void run_once(Simulator& sim, TranslatedRunner* runner, BufferTerminal& term, const std::string& input, long long steps,
+                     result& r, double& ms)
+{
+    sim.fast_reset();
+    term.input = input;
+    term.input_pos = 0;
+    term.output.clear();
+    term.output.reserve(1 << 20);
+    unsigned long long a = allocations;
+    bench_clock::time_point t = bench_clock::now();
+    if(runner != NULL)
+        runner->run(steps);
+    else
+        sim.run(steps);
+    ms = ms_since(t);
+    r.allocs = allocations - a;
+    r.instructions = sim.HistoryCount;
+    r.status = status_name(sim);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string dir = LC3_BENCH_DIR, modes = "all", only;
+    int repeat = 5, random = 200;
+    unsigned int seed = 1;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt = argv[i];
+        if(opt == "--dir")
+            dir = argv[i + 1];
+        else if(opt == "--mode")
+            modes = argv[i + 1];
+        else if(opt == "--repeat")
+            repeat = std::max(1, atoi(argv[i + 1]));
+        else if(opt == "--random")
+            random = atoi(argv[i + 1]);
+        else if(opt == "--seed")
+            seed = strtoul(argv[i + 1], NULL, 10);
+        else if(opt == "--only")
+            only = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "usage: lc3bench [--dir path] [--mode interp|probed|aot|decoded|all] [--repeat N] [--random N] [--seed N] [--only name]\n");
+            return 5;
+        }
+    }
+
+    std::vector<std::string> mode_list;
+    if(modes == "all" || modes == "interp")
+        mode_list.push_back("interp");
+    if(modes == "all" || modes == "probed")
+        mode_list.push_back("probed");
+    if(modes == "all" || modes == "aot")
+        mode_list.push_back("aot");
+    if(modes == "all" || modes == "decoded")
+        mode_list.push_back("decoded");
+
+    std::unique_ptr<Simulator> simp(new Simulator());
+    Simulator& sim = *simp;
+    BufferTerminal term;
+    Probe probe;
+    TranslatedRunner runner(sim), decoded(sim);
+    DecodeCache cache;
+    decoded.cache = &cache;
+    bench_clock::time_point t = bench_clock::now();
+    sim.initialize();
+    double init_ms = ms_since(t);
+    sim.term = &term;
+
+    std::vector<result> results;
+    for(size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        const workload& wl = workloads[w];
+        if(!only.empty() && only != wl.name)
+            continue;
+        std::string input(wl.input, 'k');
+        for(size_t m = 0; m < mode_list.size(); m++)
+        {
+            result r;
+            r.name = wl.name;
+            r.mode = mode_list[m];
+            if(r.mode == "probed")
+                sim.add_probe(&probe);
+            sim.extensions = wl.ext;
+            TranslatedRunner* on = r.mode == "aot" ? &runner : r.mode == "decoded" ? &decoded : NULL;
+
+            if(wl.file != NULL)
+            {
+                std::vector<word> bin;
+                t = bench_clock::now();
+                bool ok = sim.assemble(dir + "/" + wl.file, bin);
+                r.assemble_ms = ms_since(t);
+                sim.initialize();
+                t = bench_clock::now();
+                ok = ok && sim.load_words(bin);
+                r.load_ms = ms_since(t);
+                if(!ok)
+                {
+                    fprintf(stderr, "%s: %s", wl.file, sim.message().str().c_str());
+                    return 5;
+                }
+                sim.PC = sim.load_origin;
+                sim.save_baseline();
+                runner.attach();
+                for(int k = 0; k < repeat; k++)
+                {
+                    double ms;
+                    run_once(sim, on, term, input, LLONG_MAX, r, ms);
+                    if(k == 0 || ms < r.best_ms)
+                        r.best_ms = ms;
+                }
+            }
+            else
+            {
+                //each program runs at most 10000 steps; the times and counts are summed
+                std::vector<std::vector<word> > programs;
+                std::mt19937 rng(seed);
+                for(int i = 0; i < random; i++)
+                    programs.push_back(random_program(rng, 8 + rng() % 56));
+                for(int k = 0; k < repeat; k++)
+                {
+                    double total_ms = 0;
+                    long long total = 0;
+                    unsigned long long allocs = 0;
+                    for(int i = 0; i < random; i++)
+                    {
+                        sim.initialize();
+                        sim.load_words(programs[i]);
+                        sim.PC = 0x3000;
+                        sim.save_baseline();
+                        runner.attach();
+                        double ms;
+                        run_once(sim, on, term, input, 10000, r, ms);
+                        total_ms += ms;
+                        total += r.instructions;
+                        allocs += r.allocs;
+                    }
+                    r.instructions = total;
+                    r.allocs = allocs;
+                    r.status = "mixed";
+                    if(k == 0 || total_ms < r.best_ms)
+                        r.best_ms = total_ms;
+                }
+            }
+            if(r.mode == "probed")
+                sim.remove_probe(&probe);
+            results.push_back(r);
+        }
+    }
+
+    printf("{\n  \"initialize_ms\": %.3f,\n  \"repeat\": %d,\n  \"results\": [\n", init_ms, repeat);
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const result& r = results[i];
+        double mips = r.best_ms > 0 ? r.instructions / (r.best_ms * 1000) : 0;
+        double ns = r.instructions > 0 ? r.best_ms * 1e6 / r.instructions : 0;
+        printf("    {\"workload\": \"%s\", \"mode\": \"%s\", \"status\": \"%s\", \"instructions\": %lld, "
+               "\"ms\": %.3f, \"mips\": %.2f, \"ns_per_instruction\": %.3f, \"allocations\": %llu, "
+               "\"assemble_ms\": %.3f, \"load_ms\": %.3f}%s\n",
+               r.name.c_str(), r.mode.c_str(), r.status.c_str(), r.instructions, r.best_ms, mips, ns, r.allocs,
+               r.assemble_ms, r.load_ms, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
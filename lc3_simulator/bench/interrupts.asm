@@ -0,0 +1,57 @@
+; a busy loop under a fast periodic timer and keyboard interrupts consuming the input
+	.ORIG x3000
+	LEA R0, TISR
+	STI R0, TVEC
+	LEA R0, KISR
+	STI R0, KVEC
+	LD R0, PERIOD
+	STI R0, TMIR
+	LD R0, TCTRL
+	STI R0, TMSR
+	LD R0, KIE
+	STI R0, KBSR
+	AND R1, R1, #0
+SPIN	ADD R1, R1, #1
+	LD R2, TICKS
+	LD R3, NTARGET
+	ADD R2, R2, R3
+	BRn SPIN
+	AND R0, R0, #0
+	STI R0, TMSR
+	STI R0, KBSR
+	HALT
+
+TISR	ST R0, S0
+	LD R0, TICKS
+	ADD R0, R0, #1
+	ST R0, TICKS
+	LD R0, TCTRL
+	STI R0, TMSR
+	LD R0, S0
+	RTI
+
+KISR	ST R0, S0
+	ST R1, S1
+	LDI R0, KBDR
+	LD R1, SUM
+	ADD R1, R1, R0
+	ST R1, SUM
+	LD R0, S0
+	LD R1, S1
+	RTI
+
+TVEC	.FILL x0102
+KVEC	.FILL x0101
+PERIOD	.FILL #40
+TCTRL	.FILL x4303
+KIE	.FILL x4000
+TMIR	.FILL xFE0A
+TMSR	.FILL xFE08
+KBSR	.FILL xFE00
+KBDR	.FILL xFE02
+NTARGET	.FILL #-30000
+TICKS	.FILL #0
+SUM	.FILL #0
+S0	.BLKW #1
+S1	.BLKW #1
+	.END
@@ -0,0 +1,47 @@
+; software loops: shift-and-add products and a word-by-word block copy
+	.ORIG x3000
+	LD R1, REPS
+	ST R1, COUNT
+OUTER	LD R1, COUNT
+	ADD R2, R1, #7
+	JSR MULT
+	LD R1, SUM
+	ADD R1, R1, R0
+	ST R1, SUM
+	LD R1, COUNT
+	ADD R1, R1, #-1
+	ST R1, COUNT
+	BRp OUTER
+	LD R5, COPIES
+CLOOP	LD R1, SRCA
+	LD R2, DSTA
+	LD R3, WORDS
+WLOOP	LDR R4, R1, #0
+	STR R4, R2, #0
+	ADD R1, R1, #1
+	ADD R2, R2, #1
+	ADD R3, R3, #-1
+	BRp WLOOP
+	ADD R5, R5, #-1
+	BRp CLOOP
+	HALT
+; R0 = R1 * R2
+MULT	AND R0, R0, #0
+	ADD R4, R1, #0
+	AND R3, R3, #0
+	ADD R3, R3, #1
+MLOOP	AND R5, R2, R3
+	BRz MSKIP
+	ADD R0, R0, R4
+MSKIP	ADD R4, R4, R4
+	ADD R3, R3, R3
+	BRnp MLOOP
+	RET
+REPS	.FILL #3000
+COPIES	.FILL #100
+WORDS	.FILL #256
+SRCA	.FILL x4000
+DSTA	.FILL x4200
+COUNT	.FILL #0
+SUM	.FILL #0
+	.END
@@ -0,0 +1,30 @@
+; multiply.asm with the extension ops: MUL for the products, MCPY for the block copy
+	.ORIG x3000
+	LD R1, REPS
+	ST R1, COUNT
+OUTER	LD R1, COUNT
+	ADD R2, R1, #7
+	MUL R0, R1, R2
+	LD R1, SUM
+	ADD R1, R1, R0
+	ST R1, SUM
+	LD R1, COUNT
+	ADD R1, R1, #-1
+	ST R1, COUNT
+	BRp OUTER
+	LD R5, COPIES
+CLOOP	LD R1, SRCA
+	LD R2, DSTA
+	LD R3, WORDS
+	MCPY R2, R1, R3
+	ADD R5, R5, #-1
+	BRp CLOOP
+	HALT
+REPS	.FILL #3000
+COPIES	.FILL #100
+WORDS	.FILL #256
+SRCA	.FILL x4000
+DSTA	.FILL x4200
+COUNT	.FILL #0
+SUM	.FILL #0
+	.END
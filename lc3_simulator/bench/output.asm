@@ -0,0 +1,14 @@
+; trap-heavy display output: PUTS and OUT through the OS
+	.ORIG x3000
+	LD R5, REPS
+LOOP	LEA R0, LINE
+	PUTS
+	LD R0, NL
+	OUT
+	ADD R5, R5, #-1
+	BRp LOOP
+	HALT
+REPS	.FILL #3000
+NL	.FILL x000A
+LINE	.STRINGZ "Lorem ipsum dolor sit amet, consectetur adipiscing elit."
+	.END
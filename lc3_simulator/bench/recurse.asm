@@ -0,0 +1,37 @@
+; naive recursive Fibonacci through JSR, with a stack in R6
+	.ORIG x3000
+	LD R6, STACK
+	LD R5, REPS
+LOOP	LD R0, NFIB
+	JSR FIB
+	ADD R5, R5, #-1
+	BRp LOOP
+	ST R1, RESULT
+	HALT
+
+; R1 = fib(R0); R0 and R2 are kept
+FIB	ADD R6, R6, #-3
+	STR R7, R6, #0
+	STR R0, R6, #1
+	STR R2, R6, #2
+	ADD R1, R0, #-2
+	BRzp FIB1
+	ADD R1, R0, #0
+	BRnzp FIB2
+FIB1	ADD R0, R0, #-1
+	JSR FIB
+	ADD R2, R1, #0
+	ADD R0, R0, #-1
+	JSR FIB
+	ADD R1, R1, R2
+FIB2	LDR R7, R6, #0
+	LDR R0, R6, #1
+	LDR R2, R6, #2
+	ADD R6, R6, #3
+	RET
+
+STACK	.FILL x5000
+REPS	.FILL #20
+NFIB	.FILL #20
+RESULT	.BLKW #1
+	.END
@@ -0,0 +1,50 @@
+; insertion sort of pseudo-random arrays, REPS times
+	.ORIG x3000
+	LD R5, REPS
+OUTER	LEA R0, ARRAY		; fill the array: x = (5x + 13) & x7FFF
+	LD R1, N
+	LD R2, SEED
+	LD R4, MASK
+FILL	ADD R3, R2, R2
+	ADD R3, R3, R3
+	ADD R2, R3, R2
+	ADD R2, R2, #13
+	AND R2, R2, R4
+	STR R2, R0, #0
+	ADD R0, R0, #1
+	ADD R1, R1, #-1
+	BRp FILL
+	ST R2, SEED
+	LEA R0, ARRAY		; R0 = -&a[0]
+	NOT R0, R0
+	ADD R0, R0, #1
+	LD R1, N
+	ADD R1, R1, #-1		; R1 = elements left
+	LEA R4, ARRAY
+	ADD R4, R4, #1		; R4 = &a[i]
+ILOOP	LDR R2, R4, #0		; key
+	NOT R3, R2
+	ADD R3, R3, #1		; -key
+	ADD R7, R4, #-1		; R7 = &a[j]
+JLOOP	ADD R6, R7, R0
+	BRn JDONE
+	LDR R6, R7, #0
+	ADD R6, R6, R3		; a[j] - key
+	BRnz JDONE
+	LDR R6, R7, #0
+	STR R6, R7, #1
+	ADD R7, R7, #-1
+	BRnzp JLOOP
+JDONE	STR R2, R7, #1
+	ADD R4, R4, #1
+	ADD R1, R1, #-1
+	BRp ILOOP
+	ADD R5, R5, #-1
+	BRp OUTER
+	HALT
+REPS	.FILL #40
+N	.FILL #200
+SEED	.FILL #12345
+MASK	.FILL x7FFF
+ARRAY	.BLKW #200
+	.END
@@ -0,0 +1,74 @@
+; string processing through subroutines: upper-case copy, reverse, compare
+	.ORIG x3000
+	LD R5, REPS
+LOOP	LEA R0, TEXT
+	LEA R1, BUF
+	JSR UPCOPY
+	LEA R0, BUF
+	JSR REVERSE
+	LEA R0, BUF
+	LEA R1, BUF2
+	JSR UPCOPY
+	LEA R0, BUF
+	LEA R1, BUF2
+	JSR STRCMP
+	ADD R5, R5, #-1
+	BRp LOOP
+	HALT
+
+; copy the string at R0 to R1, upper-casing it; R2 = its length
+UPCOPY	AND R2, R2, #0
+	LD R3, NA
+UPC1	LDR R4, R0, #0
+	BRz UPC3
+	ADD R6, R4, R3		; c - 'a'
+	BRn UPC2
+	ADD R6, R6, #-13
+	ADD R6, R6, #-13	; c - 'z' - 1
+	BRzp UPC2
+	ADD R4, R4, #-16
+	ADD R4, R4, #-16
+UPC2	STR R4, R1, #0
+	ADD R0, R0, #1
+	ADD R1, R1, #1
+	ADD R2, R2, #1
+	BRnzp UPC1
+UPC3	STR R4, R1, #0
+	RET
+
+; reverse the R2 characters at R0 in place
+REVERSE	ADD R1, R0, R2
+	ADD R1, R1, #-1
+REV1	NOT R3, R0
+	ADD R3, R3, #1
+	ADD R3, R1, R3
+	BRnz REV2
+	LDR R3, R0, #0
+	LDR R4, R1, #0
+	STR R4, R0, #0
+	STR R3, R1, #0
+	ADD R0, R0, #1
+	ADD R1, R1, #-1
+	BRnzp REV1
+REV2	RET
+
+; R2 = difference of the first characters that differ in the strings at R0 and R1
+STRCMP	LDR R3, R0, #0
+	LDR R4, R1, #0
+	NOT R2, R4
+	ADD R2, R2, #1
+	ADD R2, R3, R2
+	BRnp SC2
+	ADD R3, R3, #0
+	BRz SC2
+	ADD R0, R0, #1
+	ADD R1, R1, #1
+	BRnzp STRCMP
+SC2	RET
+
+REPS	.FILL #3000
+NA	.FILL #-97
+TEXT	.STRINGZ "the quick brown fox jumps over the lazy dog, 0123456789 times"
+BUF	.BLKW #80
+BUF2	.BLKW #80
+	.END
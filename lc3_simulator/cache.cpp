@@ -0,0 +1,212 @@
+#include "cache.h"
+#include "sim.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+bool cache_config::parse(const std::string& spec)
+{
+    std::vector<std::string> ps;
+    std::stringstream strm(spec);
+    std::string p;
+    while(std::getline(strm, p, ','))
+        ps.push_back(p);
+    if(ps.size() < 3)
+        return false;
+    size = atoi(ps[0].c_str());
+    line = atoi(ps[1].c_str());
+    ways = atoi(ps[2].c_str());
+    if(size <= 0 || line <= 0 || ways <= 0 || size < line * ways)
+        return false;
+    for(size_t i = 3; i < ps.size(); i++)
+    {
+        if(ps[i] == "lru")
+            lru = true;
+        else if(ps[i] == "fifo")
+            lru = false;
+        else if(ps[i] == "wb")
+            write_back = true;
+        else if(ps[i] == "wt")
+            write_back = false;
+        else
+            return false;
+    }
+    return true;
+}
+
+std::string cache_config::str() const
+{
+    std::stringstream strm;
+    strm << size << " words, " << line << "-word lines, " << ways << "-way, "
+         << (lru ? "LRU" : "FIFO") << ", " << (write_back ? "write-back" : "write-through");
+    return strm.str();
+}
+
+void Cache::configure(const cache_config& c)
+{
+    cfg = c;
+    sets = cfg.size / (cfg.line * cfg.ways);
+    ways.assign(sets * cfg.ways, way());
+    hits = misses = writebacks = write_throughs = tick = 0;
+}
+
+bool Cache::access(word addr, bool write)
+{
+    int block = addr / cfg.line;
+    way* set = &ways[(block % sets) * cfg.ways];
+    word tag = block / sets;
+    tick++;
+
+    for(int i = 0; i < cfg.ways; i++)
+        if(set[i].valid && set[i].tag == tag)
+        {
+            hits++;
+            if(cfg.lru)
+                set[i].stamp = tick;
+            if(write && cfg.write_back)
+                set[i].dirty = true;
+            else if(write)
+                write_throughs++;
+            return true;
+        }
+
+    misses++;
+    if(write && !cfg.write_back)
+    {
+        write_throughs++;
+        return false;
+    }
+    way* victim = set;
+    for(int i = 0; i < cfg.ways; i++)
+    {
+        if(!set[i].valid)
+        {
+            victim = &set[i];
+            break;
+        }
+        if(set[i].stamp < victim->stamp)
+            victim = &set[i];
+    }
+    if(victim->valid && victim->dirty)
+        writebacks++;
+    victim->valid = true;
+    victim->dirty = write;
+    victim->tag = tag;
+    victim->stamp = tick;
+    return false;
+}
+
+void CacheProbe::count(word addr, int kind, bool hit)
+{
+    counts& r = regions[addr >> 12];
+    counts& f = functions[calls.empty() ? 0 : calls.back()];
+    if(hit)
+    {
+        r.hits[kind]++;
+        f.hits[kind]++;
+    }
+    else
+    {
+        r.misses[kind]++;
+        f.misses[kind]++;
+    }
+}
+
+void CacheProbe::fetch(Simulator& sim, word addr)
+{
+    if(call_pending || calls.empty())
+        calls.push_back(addr);
+    else if(return_pending && calls.size() > 1)
+        calls.pop_back();
+    call_pending = return_pending = false;
+
+    word instr = sim.mem[addr];
+    switch(instr >> 12)
+    {
+    case 4:         //JSR, JSRR
+        call_pending = true;
+        break;
+    case 15:        //TRAP
+        call_pending = (instr & 0xff) != 0x25;
+        break;
+    case 12:        //RET
+    case 8:         //RTI
+        return_pending = instr == 0xc1c0 || instr == 0x8000;
+        break;
+    }
+    if(icache.cfg.size > 0)
+        count(addr, 0, icache.access(addr, false));
+}
+
+void CacheProbe::read(Simulator& sim, word addr)
+{
+    if(dcache.cfg.size > 0 && addr < 0xfe00)
+        count(addr, 1, dcache.access(addr, false));
+}
+
+void CacheProbe::write(Simulator& sim, word addr)
+{
+    if(dcache.cfg.size > 0 && addr < 0xfe00)
+        count(addr, 1, dcache.access(addr, true));
+}
+
+void CacheProbe::interrupt(Simulator& sim, word vector)
+{
+    call_pending = true;
+    return_pending = false;
+}
+
+static std::string rate(unsigned long long hits, unsigned long long misses)
+{
+    std::stringstream strm;
+    if(hits + misses == 0)
+        strm << "     -";
+    else
+        strm << std::fixed << std::setprecision(1) << std::setw(5) << 100.0 * misses / (hits + misses) << "%";
+    return strm.str();
+}
+
+std::string CacheProbe::report()
+{
+    std::stringstream strm;
+    const Cache* caches[2] = {&icache, &dcache};
+    const char* names[2] = {"I-cache", "D-cache"};
+    for(int k = 0; k < 2; k++)
+    {
+        const Cache& c = *caches[k];
+        if(c.cfg.size == 0)
+            continue;
+        strm << names[k] << ": " << c.cfg.str() << std::endl
+             << "  accesses " << c.hits + c.misses << "  hits " << c.hits << "  misses " << c.misses
+             << "  miss rate" << rate(c.hits, c.misses);
+        if(k == 1)
+            strm << "  writebacks " << c.writebacks << "  write-throughs " << c.write_throughs;
+        strm << std::endl;
+    }
+
+    strm << "region          I-miss   I-acc  D-miss   D-acc" << std::endl;
+    for(int r = 0; r < 16; r++)
+    {
+        const counts& c = regions[r];
+        if(c.hits[0] + c.misses[0] + c.hits[1] + c.misses[1] == 0)
+            continue;
+        strm << Simulator::str_fulhex(r << 12) << "-" << Simulator::str_fulhex((r << 12) + 0xfff)
+             << "    " << rate(c.hits[0], c.misses[0]) << std::setw(8) << c.hits[0] + c.misses[0]
+             << "  " << rate(c.hits[1], c.misses[1]) << std::setw(8) << c.hits[1] + c.misses[1] << std::endl;
+    }
+
+    std::vector<std::pair<unsigned long long, word> > order;
+    for(std::map<word, counts>::iterator it = functions.begin(); it != functions.end(); ++it)
+        order.push_back(std::make_pair(it->second.misses[0] + it->second.misses[1], it->first));
+    std::sort(order.rbegin(), order.rend());
+    strm << "subroutine      I-miss   I-acc  D-miss   D-acc" << std::endl;
+    for(size_t i = 0; i < order.size() && i < 20; i++)
+    {
+        const counts& c = functions[order[i].second];
+        strm << Simulator::str_fulhex(order[i].second) << "          "
+             << rate(c.hits[0], c.misses[0]) << std::setw(8) << c.hits[0] + c.misses[0]
+             << "  " << rate(c.hits[1], c.misses[1]) << std::setw(8) << c.hits[1] + c.misses[1] << std::endl;
+    }
+    return strm.str();
+}
@@ -0,0 +1,75 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include "probe.h"
+#include <map>
+#include <string>
+#include <vector>
+
+//geometry and policies of one cache; sizes in words
+struct cache_config
+{
+    int size = 0;                   //0: no cache
+    int line = 4;                   //words per line
+    int ways = 1;
+    bool lru = true;                //replace the least recently used line, or the oldest one (FIFO)
+    bool write_back = true;         //write-back with write-allocate, or write-through without allocation
+
+    bool parse(const std::string& spec);    //"size,line,ways[,lru|fifo][,wb|wt]", e.g. "1024,8,2,lru,wb"
+    std::string str() const;
+};
+
+class Cache
+{
+public:
+    cache_config cfg;
+    unsigned long long hits = 0, misses = 0;
+    unsigned long long writebacks = 0;      //dirty lines evicted
+    unsigned long long write_throughs = 0;  //stores passed to memory
+
+    void configure(const cache_config& c);
+    bool access(word addr, bool write);     //true on a hit
+
+private:
+    int sets = 0;
+    unsigned long long tick = 0;
+    struct way
+    {
+        bool valid, dirty;
+        word tag;
+        unsigned long long stamp;           //last use (LRU) or fill (FIFO)
+    };
+    std::vector<way> ways;                  //sets * cfg.ways
+};
+
+/*
+    Probe feeding instruction fetches to an I-cache and data loads and stores to a D-cache.
+    Hits and misses are also counted per 4K-word region of the address space and per
+    subroutine: the entry address of the innermost JSR/JSRR/TRAP target or interrupt
+    handler that has not returned yet.
+*/
+class CacheProbe : public Probe
+{
+public:
+    Cache icache, dcache;
+
+    void fetch(Simulator& sim, word addr);
+    void read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr);
+    void interrupt(Simulator& sim, word vector);
+    std::string report();
+
+private:
+    struct counts
+    {
+        unsigned long long hits[2] = {0, 0}, misses[2] = {0, 0};     //[0] instructions, [1] data
+    };
+    counts regions[16];
+    std::map<word, counts> functions;
+    std::vector<word> calls;                //entry addresses of the subroutines running
+    bool call_pending = false, return_pending = false;
+
+    void count(word addr, int kind, bool hit);
+};
+
+#endif // CACHE_H_INCLUDED
@@ -0,0 +1,267 @@
+#include "cfg.h"
+#include "sim.h"
+#include <cstdio>
+#include <sstream>
+
+//how an instruction passes control on
+enum flow_kind
+{
+    Flow_Next,              //to the next word
+    Flow_Branch,            //conditional BR: the target or the next word
+    Flow_Jump,              //BRnzp
+    Flow_Call,              //JSR, or TRAP through the vector table: the routine, then the next word
+    Flow_Indirect_Call,     //JSRR
+    Flow_Indirect,          //JMP, RET, RTI
+    Flow_Halt               //TRAP x25
+};
+
+static flow_kind flow(word instr)
+{
+    switch(instr >> 12)
+    {
+    case 0:
+        if((instr & 0x0e00) == 0)
+            return Flow_Next;
+        return (instr & 0x0e00) == 0x0e00 ? Flow_Jump : Flow_Branch;
+    case 4:
+        return Simulator::bit(instr, 11) ? Flow_Call : Flow_Indirect_Call;
+    case 8:
+    case 12:
+        return Flow_Indirect;
+    case 15:
+        return (instr & 0xff) == 0x25 ? Flow_Halt : Flow_Call;
+    default:
+        return Flow_Next;
+    }
+}
+
+//the routine reached by the call at addr, or 0 if it is not known
+static word call_target(const Simulator& sim, word addr, word instr)
+{
+    word target;
+    if((instr >> 12) == 15)
+        return sim.mem[instr & 0xff];
+    if(Simulator::pc_target(addr, instr, target))
+        return target;
+    return 0;
+}
+
+static bool walkable(const Simulator& sim, word a)
+{
+    return a < 0xfe00 && sim.mem[a] != 0;
+}
+
+void ControlFlowGraph::walk(const Simulator& sim, word start, std::vector<word>& work)
+{
+    for(word a = start; walkable(sim, a) && !code[a]; a++)
+    {
+        code.set(a);
+        word instr = sim.mem[a];
+        word target = 0;
+        switch(flow(instr))
+        {
+        case Flow_Branch:
+        case Flow_Jump:
+            Simulator::pc_target(a, instr, target);
+            leaders.insert(target);
+            work.push_back(target);
+            if(flow(instr) == Flow_Jump)
+                return;
+            leaders.insert(a + 1);
+            break;
+        case Flow_Call:
+            target = call_target(sim, a, instr);
+            if(walkable(sim, target))
+            {
+                routines.insert(target);
+                leaders.insert(target);
+                work.push_back(target);
+            }
+            leaders.insert(a + 1);
+            break;
+        case Flow_Indirect_Call:
+            leaders.insert(a + 1);
+            break;
+        case Flow_Indirect:
+        case Flow_Halt:
+            return;
+        case Flow_Next:
+            break;
+        }
+    }
+}
+
+void ControlFlowGraph::analyze(const Simulator& sim, const std::vector<word>& entries)
+{
+    blocks.clear();
+    routines.clear();
+    leaders.clear();
+    code.reset();
+
+    std::vector<word> work;
+    for(size_t i = 0; i < entries.size(); i++)
+        if(walkable(sim, entries[i]))
+        {
+            routines.insert(entries[i]);
+            leaders.insert(entries[i]);
+            work.push_back(entries[i]);
+        }
+    while(!work.empty())
+    {
+        word a = work.back();
+        work.pop_back();
+        walk(sim, a, work);
+    }
+
+    for(std::set<word>::iterator it = leaders.begin(); it != leaders.end(); ++it)
+    {
+        if(!code[*it])
+            continue;
+        basic_block b;
+        b.start = *it;
+        word a = b.start;
+        while(flow(sim.mem[a]) == Flow_Next && code[a + 1] && !leaders.count(a + 1))
+            a++;
+        b.end = a;
+
+        word instr = sim.mem[a];
+        word target = 0;
+        switch(flow(instr))
+        {
+        case Flow_Next:
+            if(code[a + 1])
+                b.succs.push_back(a + 1);
+            break;
+        case Flow_Branch:
+        case Flow_Jump:
+            Simulator::pc_target(a, instr, target);
+            if(code[target])
+                b.succs.push_back(target);
+            if(flow(instr) == Flow_Branch && code[a + 1] && target != a + 1)
+                b.succs.push_back(a + 1);
+            break;
+        case Flow_Call:
+        case Flow_Indirect_Call:
+            target = call_target(sim, a, instr);
+            if(flow(instr) == Flow_Call && code[target])
+                b.calls.push_back(target);
+            else
+                b.indirect = true;
+            if(code[a + 1])
+                b.succs.push_back(a + 1);
+            break;
+        case Flow_Indirect:
+            b.indirect = true;
+            break;
+        case Flow_Halt:
+            b.halts = true;
+            break;
+        }
+        blocks[b.start] = b;
+    }
+}
+
+std::vector<word> ControlFlowGraph::default_entries(const Simulator& sim)
+{
+    std::vector<word> entries;
+    entries.push_back(sim.PC);
+    for(int v = 0; v < 0x200; v++)
+        if(sim.mem[v] >= 0x0200 && sim.mem[v] < 0xfe00)
+            entries.push_back(sim.mem[v]);
+    return entries;
+}
+
+const basic_block* ControlFlowGraph::block_at(word addr) const
+{
+    std::map<word, basic_block>::const_iterator it = blocks.upper_bound(addr);
+    if(it == blocks.begin())
+        return NULL;
+    --it;
+    return addr <= it->second.end ? &it->second : NULL;
+}
+
+static std::string asm_text(Simulator& sim, word instr)
+{
+    std::vector<std::string> as = sim.instr_to_asm(instr);
+    std::string text = as[0];
+    for(size_t k = 1; k < as.size(); k++)
+        text += (k == 1 ? " " : ", ") + as[k];
+    return text;
+}
+
+std::string ControlFlowGraph::listing(Simulator& sim) const
+{
+    std::stringstream strm;
+    char line[128];
+    bool gap = false;
+    for(int a = 0; a < 0xfe00; a++)
+    {
+        word h = sim.mem[a];
+        if(!code[a] && h == 0)
+        {
+            gap = true;
+            continue;
+        }
+        if(gap && strm.tellp() > 0)
+            strm << std::endl;
+        gap = false;
+
+        std::string label;
+        if(routines.count(a))
+            label = "R_" + Simulator::str_fulhex(a).substr(1);
+        else if(blocks.count(a))
+            label = "L_" + Simulator::str_fulhex(a).substr(1);
+
+        std::string text, note;
+        word target;
+        if(code[a])
+        {
+            text = asm_text(sim, h);
+            if(flow(h) == Flow_Call && (h >> 12) == 15)
+                note = "call " + Simulator::str_fulhex(sim.mem[h & 0xff]);
+            else if(flow(h) == Flow_Call && Simulator::pc_target(a, h, target))
+                note = "call " + Simulator::str_fulhex(target);
+            else if(Simulator::pc_target(a, h, target))
+                note = (flow(h) == Flow_Next ? "" : "-> ") + Simulator::str_fulhex(target);
+        }
+        else
+        {
+            text = ".FILL " + Simulator::str_fulhex(h);
+            if(h >= 0x20 && h < 0x7f)
+                note = std::string("'") + (char)h + "'";
+        }
+        if(note.empty())
+            snprintf(line, sizeof(line), "%s  %04x  %-7s %s", Simulator::str_fulhex(a).c_str(), h, label.c_str(), text.c_str());
+        else
+            snprintf(line, sizeof(line), "%s  %04x  %-7s %-22s; %s", Simulator::str_fulhex(a).c_str(), h, label.c_str(),
+                     text.c_str(), note.c_str());
+        strm << line << std::endl;
+    }
+    return strm.str();
+}
+
+std::string ControlFlowGraph::dot(Simulator& sim) const
+{
+    std::stringstream strm;
+    strm << "digraph cfg {" << std::endl
+         << "    node [shape=box, fontname=\"monospace\"];" << std::endl;
+    for(std::map<word, basic_block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        const basic_block& b = it->second;
+        strm << "    b" << Simulator::str_fulhex(b.start).substr(1) << " [label=\"";
+        for(int a = b.start; a <= b.end; a++)
+            strm << Simulator::str_fulhex(a) << "  " << asm_text(sim, sim.mem[a]) << "\\l";
+        strm << "\"";
+        if(routines.count(b.start))
+            strm << ", style=bold";
+        if(b.indirect || b.halts)
+            strm << ", color=" << (b.halts ? "red" : "blue");
+        strm << "];" << std::endl;
+        for(size_t i = 0; i < b.succs.size(); i++)
+            strm << "    b" << Simulator::str_fulhex(b.start).substr(1) << " -> b" << Simulator::str_fulhex(b.succs[i]).substr(1) << ";" << std::endl;
+        for(size_t i = 0; i < b.calls.size(); i++)
+            strm << "    b" << Simulator::str_fulhex(b.start).substr(1) << " -> b" << Simulator::str_fulhex(b.calls[i]).substr(1) << " [style=dashed];" << std::endl;
+    }
+    strm << "}" << std::endl;
+    return strm.str();
+}
@@ -0,0 +1,49 @@
+#ifndef CFG_H_INCLUDED
+#define CFG_H_INCLUDED
+
+#include <bitset>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+typedef unsigned short int word;
+
+class Simulator;
+
+//straight-line code from start to end (inclusive): entered only at start, left only after end
+struct basic_block
+{
+    word start, end;
+    std::vector<word> succs;        //blocks control may go to next inside the routine
+    std::vector<word> calls;        //routines called by JSR or TRAP at the end of the block
+    bool indirect = false;          //ends in JMP, JSRR, RET or RTI: the next address is known at run time only
+    bool halts = false;             //ends in HALT
+};
+
+/*
+    Control flow recovered statically from the memory image: everything reachable from the
+    entry points, following branches, JSR and TRAP calls, and the routines named by the
+    trap and interrupt vector tables. Words never reached as instructions are data.
+    Walking stops at x0000 words (BRnever, almost always empty memory) and at xFE00.
+*/
+class ControlFlowGraph
+{
+public:
+    std::map<word, basic_block> blocks;     //by start address
+    std::set<word> routines;                //entries: the entry points and call targets
+    std::bitset<0x10000> code;              //words reached as instructions
+
+    void analyze(const Simulator& sim, const std::vector<word>& entries);
+    static std::vector<word> default_entries(const Simulator& sim);    //PC, trap vectors x0000-x00FF, interrupt vectors x0100-x01FF
+    const basic_block* block_at(word addr) const;                       //the block containing addr, or NULL
+
+    std::string listing(Simulator& sim) const;      //disassembly of code and data, with labels and targets
+    std::string dot(Simulator& sim) const;          //Graphviz digraph of the blocks
+
+private:
+    std::set<word> leaders;
+    void walk(const Simulator& sim, word start, std::vector<word>& work);
+};
+
+#endif // CFG_H_INCLUDED
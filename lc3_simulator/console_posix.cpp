@@ -0,0 +1,116 @@
+#ifndef _WIN32
+#include "terminal.h"
+#include <cstdio>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+
+//an ANSI terminal. It is switched to raw mode while the program polls keys
+//and back to line mode when a command is read.
+class PosixTerminal : public Terminal
+{
+public:
+    termios saved;
+    bool is_tty;
+    bool raw;
+
+    PosixTerminal(): raw(false)
+    {
+        is_tty = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved) == 0;
+    }
+    ~PosixTerminal()
+    {
+        set_raw(false);
+        printf("\033[0m");
+    }
+
+    void set_raw(bool on)
+    {
+        if(!is_tty || raw == on)
+            return;
+        if(on)
+        {
+            termios t = saved;
+            t.c_lflag &= ~(ICANON | ECHO);
+            t.c_cc[VMIN] = 1;
+            t.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSANOW, &t);
+        }
+        else
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        raw = on;
+    }
+
+    bool input_ready()
+    {
+        pollfd p;
+        p.fd = STDIN_FILENO;
+        p.events = POLLIN;
+        return poll(&p, 1, 0) > 0;
+    }
+
+    bool kbhit()
+    {
+        set_raw(true);
+        return input_ready();
+    }
+    int getch()
+    {
+        set_raw(true);
+        fflush(stdout);
+        unsigned char c;
+        if(read(STDIN_FILENO, &c, 1) != 1)
+            return -1;
+        if(c == 27 && input_ready())
+        {//arrow keys arrive as ESC [ A/B; report them like the 'w'/'s' keys
+            unsigned char seq[2];
+            if(read(STDIN_FILENO, seq, 2) == 2 && seq[0] == '[')
+            {
+                if(seq[1] == 'A') return 'w';
+                if(seq[1] == 'B') return 's';
+            }
+        }
+        return c;
+    }
+    void put_char(char c)
+    {
+        putchar(c);
+        fflush(stdout);
+    }
+    bool getline(char str[], int n)
+    {
+        set_raw(false);
+        fflush(stdout);
+        if(fgets(str, n, stdin) == NULL)
+            return false;
+        str[strcspn(str, "\r\n")] = '\0';
+        return true;
+    }
+    void cursor_xy(int x, int y)
+    {
+        printf("\033[%d;%dH", y+1, x+1);
+    }
+    void text_color(unsigned short int color)
+    {
+        static const int ansi[8] = {0, 4, 2, 6, 1, 5, 3, 7};      //console BGR bits to ANSI RGB order
+        int fg = color & 0x0f, bg = (color >> 4) & 0x0f;
+        printf("\033[%d;%dm", (fg & 8 ? 90 : 30) + ansi[fg & 7], (bg & 8 ? 100 : 40) + ansi[bg & 7]);
+    }
+    void clear_screen()
+    {
+        printf("\033[2J\033[H");
+    }
+    void pause()
+    {
+        char buf[8];
+        printf("Press Enter to continue . . .");
+        getline(buf, sizeof(buf));
+    }
+};
+
+Terminal* create_console_terminal()
+{
+    return new PosixTerminal();
+}
+
+#endif // _WIN32
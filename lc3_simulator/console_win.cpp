@@ -0,0 +1,51 @@
+#ifdef _WIN32
+#include "terminal.h"
+#include <conio.h>
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+//the Windows console, driven through conio and the console API.
+class WinTerminal : public Terminal
+{
+public:
+    HANDLE stdOutputHandle;
+
+    WinTerminal()
+    {
+        stdOutputHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+        system("mode con cols=90");
+    }
+
+    bool kbhit() {return _kbhit();}
+    int getch() {return _getch();}
+    void put_char(char c) {printf("%c", c);}
+    bool getline(char str[], int n)
+    {
+        if(std::cin.getline(str, n))
+            return true;
+        std::cin.clear();
+        return false;
+    }
+    void cursor_xy(int x, int y)
+    {
+        COORD coord;
+        coord.X = x;
+        coord.Y = y;
+        SetConsoleCursorPosition(stdOutputHandle, coord);
+    }
+    void text_color(unsigned short int color)
+    {
+        SetConsoleTextAttribute(stdOutputHandle, color);
+    }
+    void clear_screen() {system("cls");}
+    void pause() {system("pause");}
+};
+
+Terminal* create_console_terminal()
+{
+    return new WinTerminal();
+}
+
+#endif // _WIN32
@@ -0,0 +1,224 @@
+#include "coverage.h"
+#include "assembler.h"
+#include "sim.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+SourceCoverage::SourceCoverage()
+{
+    clear();
+}
+
+void SourceCoverage::clear()
+{
+    memset(executed, 0, sizeof(executed));
+    memset(taken, 0, sizeof(taken));
+    memset(not_taken, 0, sizeof(not_taken));
+}
+
+void SourceCoverage::retire(Simulator& sim, word addr)
+{
+    unsigned char bit = 1 << (addr & 7);
+    executed[addr>>3] |= bit;
+    if(sim.IR>>12 == 0)
+    {
+        //BR leaves the condition codes as it found them
+        if(Simulator::slice(sim.IR, 9, 12) & Simulator::slice(sim.PSR, 0, 3))
+            taken[addr>>3] |= bit;
+        else
+            not_taken[addr>>3] |= bit;
+    }
+}
+
+void CoverageReport::add(const debug_map& map, const SourceCoverage& run)
+{
+    std::map<int, line_count>& lines = files[map.source];
+    for(size_t i = 0; i < map.lines.size(); i++)
+    {
+        const source_line& l = map.lines[i];
+        if(!l.code)
+            continue;
+        line_count& c = lines[l.line];
+        c.hits += SourceCoverage::test(run.executed, l.addr);
+        if(l.branch)
+        {
+            c.branch = true;
+            c.taken += SourceCoverage::test(run.taken, l.addr);
+            c.not_taken += SourceCoverage::test(run.not_taken, l.addr);
+        }
+    }
+}
+
+bool CoverageReport::parse(const std::string& info)
+{
+    std::stringstream strm(info);
+    std::string s;
+    std::map<int, line_count>* lines = NULL;
+    while(std::getline(strm, s))
+    {
+        if(!s.empty() && s[s.size() - 1] == '\r')
+            s.erase(s.size() - 1);
+        if(s.empty() || s == "end_of_record")
+            continue;
+        size_t colon = s.find(':');
+        if(colon == std::string::npos)
+            return false;
+        std::string key = s.substr(0, colon), val = s.substr(colon + 1);
+        if(key == "SF")
+            lines = &files[val];
+        else if(key == "DA" && lines != NULL)
+        {
+            int line;
+            unsigned long long hits;
+            if(sscanf(val.c_str(), "%d,%llu", &line, &hits) != 2)
+                return false;
+            (*lines)[line].hits += hits;
+        }
+        else if(key == "BRDA" && lines != NULL)
+        {
+            int line, block, branch;
+            char count[32];
+            if(sscanf(val.c_str(), "%d,%d,%d,%31s", &line, &block, &branch, count) != 4)
+                return false;
+            line_count& c = (*lines)[line];
+            unsigned long long n = count[0] == '-' ? 0 : strtoull(count, NULL, 10);
+            c.branch = true;
+            (branch == 0 ? c.taken : c.not_taken) += n;
+        }
+        //TN, FN, LF, LH, BRF, BRH and the rest are summaries or records of no use here
+    }
+    return true;
+}
+
+std::string CoverageReport::info() const
+{
+    std::stringstream strm;
+    for(std::map<std::string, std::map<int, line_count> >::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        int brf = 0, brh = 0, lf = 0, lh = 0;
+        strm << "TN:" << std::endl << "SF:" << f->first << std::endl;
+        for(std::map<int, line_count>::const_iterator l = f->second.begin(); l != f->second.end(); ++l)
+            if(l->second.branch)
+            {
+                for(int b = 0; b < 2; b++)
+                {
+                    unsigned long long n = b == 0 ? l->second.taken : l->second.not_taken;
+                    strm << "BRDA:" << l->first << ",0," << b << ",";
+                    if(l->second.hits == 0)
+                        strm << "-";                //the line never ran
+                    else
+                        strm << n;
+                    strm << std::endl;
+                    brf++;
+                    brh += n > 0;
+                }
+            }
+        strm << "BRF:" << brf << std::endl << "BRH:" << brh << std::endl;
+        for(std::map<int, line_count>::const_iterator l = f->second.begin(); l != f->second.end(); ++l)
+        {
+            strm << "DA:" << l->first << "," << l->second.hits << std::endl;
+            lf++;
+            lh += l->second.hits > 0;
+        }
+        strm << "LF:" << lf << std::endl << "LH:" << lh << std::endl << "end_of_record" << std::endl;
+    }
+    return strm.str();
+}
+
+std::string CoverageReport::text() const
+{
+    std::stringstream strm;
+    for(std::map<std::string, std::map<int, line_count> >::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        const std::map<int, line_count>& lines = f->second;
+        int brf = 0, brh = 0, lh = 0;
+        for(std::map<int, line_count>::const_iterator l = lines.begin(); l != lines.end(); ++l)
+        {
+            lh += l->second.hits > 0;
+            if(l->second.branch)
+            {
+                brf += 2;
+                brh += (l->second.taken > 0) + (l->second.not_taken > 0);
+            }
+        }
+        strm << f->first << ": " << lh << " of " << lines.size() << " lines, " << brh << " of " << brf << " branches" << std::endl;
+
+        //the source, if it is still there; else the lines of code alone
+        std::vector<std::string> source;
+        std::ifstream in(f->first);
+        std::string s;
+        while(std::getline(in, s))
+            source.push_back(s);
+        int last = lines.empty() ? 0 : lines.rbegin()->first;
+        if((int)source.size() > last)
+            last = source.size();
+        for(int n = 1; n <= last; n++)
+        {
+            std::map<int, line_count>::const_iterator l = lines.find(n);
+            if(l == lines.end() && source.empty())
+                continue;
+            char buf[32];
+            if(l == lines.end())
+                snprintf(buf, sizeof(buf), "        -:%5d:", n);
+            else if(l->second.hits > 0)
+                snprintf(buf, sizeof(buf), "%9llu:%5d:", l->second.hits, n);
+            else
+                snprintf(buf, sizeof(buf), "    #####:%5d:", n);
+            strm << buf << (n <= (int)source.size() ? source[n-1] : "") << std::endl;
+            if(l != lines.end() && l->second.branch)
+                strm << "                taken " << l->second.taken << ", not taken " << l->second.not_taken << std::endl;
+        }
+    }
+    return strm.str();
+}
+
+bool CoverageReport::merge_file(const std::string& filename)
+{
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        return false;
+    if(flock(fd, LOCK_EX) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    std::string old;
+    char buf[65536];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        old.append(buf, n);
+    bool ok = n == 0 && parse(old);
+    if(ok)
+    {
+        std::string s = info();
+        ok = ftruncate(fd, 0) == 0;
+        for(size_t done = 0; ok && done < s.size(); done += n)
+            ok = (n = pwrite(fd, s.data() + done, s.size() - done, done)) > 0;
+    }
+    ::close(fd);                        //and the lock with it
+    return ok;
+#else
+    std::ifstream in(filename);
+    if(in.is_open())
+    {
+        std::stringstream ss;
+        ss << in.rdbuf();
+        if(!parse(ss.str()))
+            return false;
+        in.close();
+    }
+    std::ofstream out(filename);
+    out << info();
+    return (bool)out;
+#endif // _WIN32
+}
@@ -0,0 +1,53 @@
+#ifndef COVERAGE_H_INCLUDED
+#define COVERAGE_H_INCLUDED
+
+#include "probe.h"
+#include <map>
+#include <string>
+
+struct debug_map;
+
+//the addresses executed in a run, and the outcomes each BR there had
+class SourceCoverage : public Probe
+{
+public:
+    unsigned char executed[0x10000 / 8];
+    unsigned char taken[0x10000 / 8];
+    unsigned char not_taken[0x10000 / 8];
+
+    SourceCoverage();
+    void clear();
+    void retire(Simulator& sim, word addr);
+
+    static bool test(const unsigned char* bits, word addr) {return bits[addr>>3] >> (addr & 7) & 1;}
+};
+
+/*
+    Line and branch coverage of assembly sources, over any number of runs. A run adds one
+    to the count of every line it executed and of every branch outcome it had, so a count
+    is of the runs exercising the line, not of its executions.
+
+    The report is kept as an lcov tracefile (.info): DA records for the instruction lines,
+    BRDA records (block 0, branch 0 taken, branch 1 not taken) for the conditional
+    branches. merge_file() adds it to a tracefile under an exclusive lock, so the runs of
+    a test suite may all write to one file in parallel.
+*/
+class CoverageReport
+{
+public:
+    struct line_count
+    {
+        unsigned long long hits = 0;
+        bool branch = false;
+        unsigned long long taken = 0, not_taken = 0;
+    };
+    std::map<std::string, std::map<int, line_count> > files;    //source file -> line -> counts
+
+    void add(const debug_map& map, const SourceCoverage& run);
+    bool parse(const std::string& info);            //add the counts of a tracefile; false if it is not one
+    std::string info() const;                       //as an lcov tracefile
+    std::string text() const;                       //each source annotated with its counts, gcov-like
+    bool merge_file(const std::string& filename);   //add the counts of the file to these and write them back into it
+};
+
+#endif // COVERAGE_H_INCLUDED
@@ -0,0 +1,275 @@
+#include "decode.h"
+#include "sim.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum decoded_kind
+{
+    Op_BR, Op_ADD, Op_ADDimm, Op_LD, Op_ST, Op_JSR, Op_JSRR, Op_AND, Op_ANDimm, Op_LDR,
+    Op_STR, Op_RTI, Op_NOT, Op_LDI, Op_STI, Op_JMP, Op_EXT, Op_LEA, Op_TRAP
+};
+
+static const char cache_magic[8] = {'L', 'C', '3', 'D', 'E', 'C', 'O', 'D'};
+static const unsigned int cache_version = 1;          //of the file and of decoded_instr
+
+//FNV-1a
+static unsigned long long fnv(const void* data, size_t n, unsigned long long h = 14695981039346656037ULL)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for(size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+static unsigned long long record_check(const decoded_page& page)
+{
+    return fnv(page.code, sizeof(page.code), page.hash);
+}
+
+unsigned long long DecodeCache::hash(const word* page)
+{
+    return fnv(page, 0x100 * sizeof(word));
+}
+
+decoded_instr DecodeCache::decode(word h)
+{
+    decoded_instr d;
+    d.instr = h;
+    d.a = Simulator::slice(h, 9, 12);
+    d.b = Simulator::slice(h, 6, 9);
+    d.c = Simulator::slice(h, 0, 3);
+    d.imm = Simulator::slice(h, 0, 9);
+    switch(h>>12)
+    {
+    case 0: d.kind = Op_BR; break;
+    case 1: d.kind = Simulator::bit(h, 5) ? Op_ADDimm : Op_ADD; d.imm = Simulator::slice(h, 0, 5); break;
+    case 2: d.kind = Op_LD; break;
+    case 3: d.kind = Op_ST; break;
+    case 4: d.kind = Simulator::bit(h, 11) ? Op_JSR : Op_JSRR; d.imm = Simulator::slice(h, 0, 11); break;
+    case 5: d.kind = Simulator::bit(h, 5) ? Op_ANDimm : Op_AND; d.imm = Simulator::slice(h, 0, 5); break;
+    case 6: d.kind = Op_LDR; d.imm = Simulator::slice(h, 0, 6); break;
+    case 7: d.kind = Op_STR; d.imm = Simulator::slice(h, 0, 6); break;
+    case 8: d.kind = Op_RTI; break;
+    case 9: d.kind = Op_NOT; break;
+    case 10: d.kind = Op_LDI; break;
+    case 11: d.kind = Op_STI; break;
+    case 12: d.kind = Op_JMP; break;
+    case 13: d.kind = Op_EXT; d.imm = Simulator::slice(h, 3, 6); break;
+    case 14: d.kind = Op_LEA; break;
+    default: d.kind = Op_TRAP; d.imm = Simulator::slice(h, 0, 8); break;
+    }
+    return d;
+}
+
+DecodeCache::DecodeCache()
+{
+}
+
+DecodeCache::~DecodeCache()
+{
+    close();
+}
+
+bool DecodeCache::open(const std::string& filename, int n)
+{
+    close();
+    if(n <= 0 || n > max_slots)
+        return false;
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDWR);
+    size_t size = 0;
+    if(fd >= 0)
+    {
+        //the table of the file, whatever size was asked for, if it is one
+        file_header h;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h)
+           && memcmp(h.magic, cache_magic, sizeof(cache_magic)) == 0 && h.version == cache_version
+           && h.slots > 0 && h.slots <= (unsigned int)max_slots
+           && (size_t)st.st_size == sizeof(file_header) + (size_t)h.slots * sizeof(decoded_page))
+        {
+            n = h.slots;
+            size = st.st_size;
+        }
+        else
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    if(fd < 0)
+    {
+        //a new file, with its header written before it replaces the old one
+        std::stringstream tmp;
+        tmp << filename << ".new." << getpid();
+        fd = ::open(tmp.str().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+            return false;
+        size = sizeof(file_header) + (size_t)n * sizeof(decoded_page);
+        file_header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, cache_magic, sizeof(cache_magic));
+        h.version = cache_version;
+        h.slots = n;
+        if(ftruncate(fd, size) != 0 || pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)
+           || rename(tmp.str().c_str(), filename.c_str()) != 0)
+        {
+            ::close(fd);
+            unlink(tmp.str().c_str());
+            return false;
+        }
+    }
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(p == MAP_FAILED)
+        return false;
+    header = (file_header*)p;
+    slots = (decoded_page*)(header + 1);
+    slot_count = n;
+    mapped_size = size;
+    return true;
+#else
+    return false;
+#endif // _WIN32
+}
+
+void DecodeCache::close()
+{
+#ifndef _WIN32
+    if(header != NULL)
+        munmap(header, mapped_size);
+#endif // _WIN32
+    header = NULL;
+    slots = NULL;
+    slot_count = 0;
+    mapped_size = 0;
+}
+
+//the record holds the decode of these words, whole
+static bool record_valid(const decoded_page& r, unsigned long long h, const word* page)
+{
+    if(r.hash != h || r.check != record_check(r))
+        return false;
+    for(int i = 0; i < 0x100; i++)
+        if(r.code[i].instr != page[i])
+            return false;
+    return true;
+}
+
+const decoded_page* DecodeCache::get(const word* page)
+{
+    unsigned long long h = hash(page);
+    typedef std::unordered_multimap<unsigned long long, std::unique_ptr<decoded_page> >::iterator page_iter;
+    std::pair<page_iter, page_iter> same = pages.equal_range(h);
+    for(page_iter it = same.first; it != same.second; ++it)
+        if(record_valid(*it->second, h, page))
+        {
+            hits++;
+            return it->second.get();
+        }
+
+    decoded_page* local = new decoded_page;
+    pages.insert(std::make_pair(h, std::unique_ptr<decoded_page>(local)));
+    if(slots != NULL)
+    {
+        //a few slots from the home one; copied out first, as another process may be writing it
+        for(unsigned int k = 0; k < 4; k++)
+        {
+            memcpy(local, &slots[(h + k) % slot_count], sizeof(decoded_page));
+            if(record_valid(*local, h, page))
+            {
+                file_hits++;
+                return local;
+            }
+        }
+    }
+
+    misses++;
+    local->hash = h;
+    for(int i = 0; i < 0x100; i++)
+        local->code[i] = decode(page[i]);
+    local->check = record_check(*local);
+    if(slots != NULL)
+    {
+        //into the first slot not holding a good record, else the home slot
+        unsigned int s = h % slot_count;
+        for(unsigned int k = 0; k < 4; k++)
+        {
+            decoded_page& r = slots[(h + k) % slot_count];
+            if(r.check != record_check(r))
+            {
+                s = (h + k) % slot_count;
+                break;
+            }
+        }
+        memcpy(&slots[s], local, sizeof(decoded_page));
+    }
+    return local;
+}
+
+std::string DecodeCache::report()
+{
+    std::stringstream strm;
+    strm << "decode cache: " << hits << " hits, " << file_hits << " from the file, " << misses << " pages decoded";
+    if(header != NULL)
+        strm << ", " << slot_count << " slots in the file";
+    strm << std::endl;
+    return strm.str();
+}
+
+int run_decoded(Simulator& s, const decoded_page& page, unsigned long long stop)
+{
+    word base = s.PC & 0xff00;
+    int n = 0;
+    while(s.cycle < stop && s.cycle < s.next_event)
+    {
+        word pc = s.PC;
+        if((pc & 0xff00) != base)
+            break;
+        const decoded_instr& d = page.code[pc & 0xff];
+        if(s.mem[pc] != d.instr)
+            break;
+        s.MAR = pc;
+        s.PC = pc + 1;
+        s.MDR = s.IR = d.instr;
+        s.metrics.opcodes[d.instr>>12]++;
+        switch(d.kind)
+        {
+        case Op_BR:     s.BR(d.a, d.imm); break;
+        case Op_ADD:    s.ADD(d.a, d.b, d.c); break;
+        case Op_ADDimm: s.ADDimm(d.a, d.b, d.imm); break;
+        case Op_LD:     s.LD(d.a, d.imm); break;
+        case Op_ST:     s.ST(d.a, d.imm); break;
+        case Op_JSR:    s.JSR(d.imm); break;
+        case Op_JSRR:   s.JSRR(d.b); break;
+        case Op_AND:    s.AND(d.a, d.b, d.c); break;
+        case Op_ANDimm: s.ANDimm(d.a, d.b, d.imm); break;
+        case Op_LDR:    s.LDR(d.a, d.b, d.imm); break;
+        case Op_STR:    s.STR(d.a, d.b, d.imm); break;
+        case Op_RTI:    s.RTI(); break;
+        case Op_NOT:    s.NOT(d.a, d.b); break;
+        case Op_LDI:    s.LDI(d.a, d.imm); break;
+        case Op_STI:    s.STI(d.a, d.imm); break;
+        case Op_JMP:    s.JMP(d.b); break;
+        case Op_EXT:
+            if(s.extensions)
+                s.EXT(d.a, d.b, d.imm, d.c);
+            break;
+        case Op_LEA:    s.LEA(d.a, d.imm); break;
+        case Op_TRAP:   s.TRAP(d.imm); break;
+        }
+        s.HistoryCount++;
+        s.cycle++;
+        n++;
+        if(s.sim_status != Simulator::Normal)
+            break;
+    }
+    return n;
+}
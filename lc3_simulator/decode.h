@@ -0,0 +1,75 @@
+#ifndef DECODE_H_INCLUDED
+#define DECODE_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+typedef unsigned short int word;
+
+class Simulator;
+
+//an instruction with its fields taken out, ready for the Simulator method of its kind
+struct decoded_instr
+{
+    word instr;                         //the word decoded; the run checks it against memory
+    unsigned char kind, a, b, c;        //kind and register fields
+    word imm;                           //offset, immediate or trap vector, not sign-extended
+};
+
+//the decode of a 256-word page, every word taken as an instruction
+struct decoded_page
+{
+    unsigned long long hash;            //of the words of the page
+    unsigned long long check;           //of the record, against torn writes to the cache file
+    decoded_instr code[0x100];
+};
+
+/*
+    Predecoded pages by content hash. A page is decoded once per process, and with a cache
+    file once for all the processes sharing that file: the file is a table of
+    decoded_page records, memory-mapped, which lookups copy out of and new decodes are
+    written into. A record is taken only if its check and its words are right, so a stale,
+    colliding or half-written one is decoded again and replaced; the copies a run uses
+    never change under it, and pages whose hashes collide are kept side by side. A file
+    of another format or size is replaced by a new one renamed over it, never truncated,
+    as other processes may have it mapped. Without mmap (Windows) the cache lives in the
+    process only.
+*/
+class DecodeCache
+{
+public:
+    unsigned long long hits = 0, file_hits = 0, misses = 0;     //in the process, in the file, decoded
+
+    DecodeCache();
+    ~DecodeCache();
+    static const int max_slots = 1 << 20;
+    bool open(const std::string& filename, int slots = 4096);  //share the pages with this file; false if it cannot be mapped or slots is not 1 to max_slots
+    const decoded_page* get(const word* page);                  //the decode of the 256 words at page
+    std::string report();
+
+    static decoded_instr decode(word instr);
+    static unsigned long long hash(const word* page);
+
+private:
+    struct file_header
+    {
+        char magic[8];
+        unsigned int version, slots;
+    };
+    std::unordered_multimap<unsigned long long, std::unique_ptr<decoded_page> > pages;     //never removed, as runs may hold them
+    file_header* header = NULL;
+    decoded_page* slots = NULL;         //of the mapped file
+    unsigned int slot_count = 0;        //header->slots when mapped; the header is shared and not read again
+    size_t mapped_size = 0;
+    void close();
+};
+
+/*
+    Runs the instructions decoded on page from PC while PC stays on it, the words are those
+    decoded and the run status is Normal, till cycle stop or the next device event. The
+    number of instructions run.
+*/
+int run_decoded(Simulator& s, const decoded_page& page, unsigned long long stop);
+
+#endif // DECODE_H_INCLUDED
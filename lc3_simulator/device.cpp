@@ -0,0 +1,282 @@
+#include "device.h"
+#include "sim.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+word Device::read(Simulator& sim, word addr)
+{
+    return sim.mem[addr];
+}
+
+void Device::write(Simulator& sim, word addr, word v)
+{
+    sim.mem[addr] = v;
+}
+
+KeyboardDevice::KeyboardDevice(Simulator& sim)
+{
+    line = sim.add_irq("keyboard", 0x01, 0x0001);
+}
+
+KeyboardDevice::~KeyboardDevice()
+{
+    stop_record();
+}
+
+bool KeyboardDevice::scripted(Simulator& sim)
+{
+    return !replaying && sim.term != NULL && !sim.term->interactive;
+}
+
+word KeyboardDevice::read(Simulator& sim, word addr)
+{
+    if(addr == Simulator::KBSR_ && !Simulator::bit(sim.mem[addr], 15))
+        stalls++;
+    if(addr == Simulator::KBDR_)
+    {
+        sim.mem[Simulator::KBSR_] &= 0x7fff;
+        sim.set_irq(line, false);
+        if(scripted(sim))
+            sim.schedule(this, 1);              //the next scripted key arrives after this one was read
+    }
+    return sim.mem[addr];
+}
+
+void KeyboardDevice::write(Simulator& sim, word addr, word v)
+{
+    sim.mem[addr] = v;
+    if(addr == Simulator::KBSR_)
+    {
+        if(!Simulator::bit(v, 15) && scripted(sim))
+            sim.schedule(this, 1);              //the key was thrown away; bring the next one
+        sim.set_irq(line, Simulator::bit(v, 14) && Simulator::bit(v, 15));
+    }
+}
+
+void KeyboardDevice::take_key(Simulator& sim, int key)
+{
+    word* mem = sim.mem;
+    if(record != NULL)
+    {
+        if(key == Key_Esc)
+            fprintf(record, "%llu esc\n", sim.cycle - log_start);
+        else
+            fprintf(record, "%llu %d\n", sim.cycle - log_start, key);
+        fflush(record);                         //the log is complete however the simulator ends
+    }
+    if(key == Key_Esc)
+    {
+        sim.sim_status = Simulator::User_Interrupt;
+        return;
+    }
+    //INPUT
+    mem[Simulator::KBSR_] = (mem[Simulator::KBSR_] & 0x7fff) + 0x8000;
+    mem[Simulator::KBDR_] =  key&0x00ff;
+    sim.set_irq(line, Simulator::bit(mem[Simulator::KBSR_], 14));
+}
+
+//post the event of the next key replayed, or go back to the terminal after the last one
+void KeyboardDevice::next_replay(Simulator& sim)
+{
+    if(replay_pos == replay.size())
+    {
+        replaying = false;
+        replay_next = ~0ULL;
+        sim.schedule(this, 0);
+        return;
+    }
+    unsigned long long t = log_start + replay[replay_pos].cycle;
+    if(t != replay_next)
+    {
+        sim.schedule(this, t > sim.cycle ? t - sim.cycle : 0);
+        replay_next = t;
+    }
+}
+
+void KeyboardDevice::event(Simulator& sim, word tag)
+{
+    Terminal* term = sim.term;
+    word* mem = sim.mem;
+    if(replaying)
+    {
+        //one key a step, as a console poll takes them
+        if(replay_pos < replay.size() && log_start + replay[replay_pos].cycle <= sim.cycle)
+        {
+            replay_next = ~0ULL;
+            take_key(sim, replay[replay_pos++].key);
+        }
+        next_replay(sim);
+        return;
+    }
+    if(term==NULL || term->interactive)
+        sim.schedule(this, poll_interval);      //a console is polled all along
+    //dealing with InputZ
+    if(term==NULL || (!term->interactive && Simulator::bit(mem[Simulator::KBSR_], 15)))
+        return;             //scripted input waits until the program has read the last key
+    if(term->kbhit())
+    {
+        int kb = term->getch();
+        if(kb==27 && term->interactive)          //press esc to cause User_Interrupt(suspend the program and into the command mode)
+            take_key(sim, Key_Esc);
+        else
+            take_key(sim, kb);
+    }
+}
+
+void KeyboardDevice::reset(Simulator& sim)
+{
+    word kbsr = sim.mem[Simulator::KBSR_];
+    stop_record();
+    replaying = !replay.empty();
+    replay_pos = 0;
+    replay_next = ~0ULL;
+    log_start = 0;
+    sim.schedule(this, 0);
+    sim.set_irq(line, Simulator::bit(kbsr, 14) && Simulator::bit(kbsr, 15));
+}
+
+bool KeyboardDevice::start_record(Simulator& sim, const std::string& filename)
+{
+    stop_record();
+    record = fopen(filename.c_str(), "w");
+    if(record == NULL)
+        return false;
+    fprintf(record, "lc3 keys 1\n");
+    log_start = sim.cycle;
+    return true;
+}
+
+void KeyboardDevice::stop_record()
+{
+    if(record != NULL)
+        fclose(record);
+    record = NULL;
+}
+
+void KeyboardDevice::stop_replay(Simulator& sim)
+{
+    replay.clear();
+    if(replaying)
+        sim.schedule(this, 0);
+    replaying = false;
+    replay_next = ~0ULL;
+}
+
+bool KeyboardDevice::start_replay(Simulator& sim, const std::string& filename)
+{
+    std::ifstream f(filename.c_str());
+    std::string magic, kind, version, key;
+    if(!(f >> magic >> kind >> version) || magic != "lc3" || kind != "keys" || version != "1")
+        return false;
+    std::vector<key_event> keys;
+    key_event e;
+    while(f >> e.cycle >> key)
+    {
+        e.key = key == "esc" ? Key_Esc : atoi(key.c_str());
+        if(!keys.empty() && e.cycle < keys.back().cycle)
+            return false;
+        keys.push_back(e);
+    }
+    if(!f.eof())
+        return false;
+    replay = keys;
+    replaying = !replay.empty();
+    replay_pos = 0;
+    replay_next = ~0ULL;
+    log_start = sim.cycle;
+    if(replaying)
+        next_replay(sim);
+    return true;
+}
+
+word DisplayDevice::read(Simulator& sim, word addr)
+{
+    if(addr == Simulator::DSR_ && !Simulator::bit(sim.mem[addr], 15))
+        stalls++;
+    return sim.mem[addr];
+}
+
+void DisplayDevice::write(Simulator& sim, word addr, word v)
+{
+    sim.mem[addr] = v;
+    if(addr == Simulator::DDR_)
+    {
+        sim.mem[Simulator::DSR_] &= 0x7fff;
+        sim.schedule(this, 1);
+    }
+}
+
+void DisplayDevice::event(Simulator& sim, word tag)
+{
+    word* mem = sim.mem;
+    if((mem[Simulator::DSR_]&0x8000) == 0)
+    {
+        if(sim.term!=NULL)
+            sim.term->put_char(mem[Simulator::DDR_]&0x00ff);
+        mem[Simulator::DSR_] = (mem[Simulator::DSR_] & 0x7fff) + 0x8000;
+    }
+}
+
+TimerDevice::TimerDevice(Simulator& sim)
+{
+    line = sim.add_irq("timer", 0x02, 0);
+}
+
+void TimerDevice::start(Simulator& sim)
+{
+    gen++;
+    if(Simulator::bit(sim.mem[Simulator::TMSR_], 0))
+        sim.schedule(this, std::max<word>(sim.mem[Simulator::TMIR_], 1), gen);
+}
+
+void TimerDevice::write(Simulator& sim, word addr, word v)
+{
+    word* mem = sim.mem;
+    if(addr == Simulator::TMSR_)
+    {
+        //a write acknowledges the expiry; setting the run bit starts a new period
+        bool restart = Simulator::bit(v, 0) != Simulator::bit(mem[Simulator::TMSR_], 0);
+        mem[Simulator::TMSR_] = v & 0x7fff;
+        if(restart)
+            start(sim);
+        sim.set_irq_priority(line, Simulator::slice(v, 8, 11));
+        sim.set_irq(line, false);
+    }
+    else
+    {
+        mem[addr] = v;
+        if(addr == Simulator::TMIR_)
+            start(sim);
+    }
+}
+
+void TimerDevice::event(Simulator& sim, word tag)
+{
+    word* mem = sim.mem;
+    if(tag != gen || !Simulator::bit(mem[Simulator::TMSR_], 0))
+        return;             //the timer was stopped or reprogrammed since
+    mem[Simulator::TMSR_] |= 0x8000;
+    if(Simulator::bit(mem[Simulator::TMSR_], 1))
+        sim.schedule(this, std::max<word>(mem[Simulator::TMIR_], 1), gen);
+    else
+        mem[Simulator::TMSR_] &= 0xfffe;        //a one-shot timer stops
+    sim.set_irq(line, Simulator::bit(mem[Simulator::TMSR_], 14));
+}
+
+void TimerDevice::reset(Simulator& sim)
+{
+    word tmsr = sim.mem[Simulator::TMSR_];
+    start(sim);
+    sim.set_irq_priority(line, Simulator::slice(tmsr, 8, 11));
+    sim.set_irq(line, Simulator::bit(tmsr, 14) && Simulator::bit(tmsr, 15));
+}
+
+void InterruptControllerDevice::write(Simulator& sim, word addr, word v)
+{
+    if(addr == Simulator::ICPR_)
+        return;                                 //the requests belong to the devices
+    sim.mem[addr] = v;
+    sim.update_irq_levels();
+    sim.schedule(NULL, 0);
+}
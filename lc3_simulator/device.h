@@ -0,0 +1,109 @@
+#ifndef DEVICE_H_INCLUDED
+#define DEVICE_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef unsigned short int word;
+
+class Simulator;
+
+//a memory-mapped device, registered with Simulator::add_device()
+class Device
+{
+public:
+    virtual ~Device(){}
+    virtual word read(Simulator& sim, word addr);           //a load from one of its addresses; by default the memory word
+    virtual void write(Simulator& sim, word addr, word v);  //a store to one of its addresses; by default to the memory word
+    virtual void event(Simulator& sim, word tag){}          //an event it posted with Simulator::schedule() is due
+    virtual void reset(Simulator& sim){}                    //the device clock restarted at cycle 0, e.g. after fast_reset()
+    virtual const char* name(){return "device";}
+
+    unsigned long long stalls = 0;                          //polls of its status register that found it not ready
+};
+
+//a key the keyboard took, at a cycle counted from the start of the recording
+struct key_event
+{
+    unsigned long long cycle;
+    int key;                                //a character, or Key_Esc
+};
+
+/*
+    KBSR xFE00, KBDR xFE02: a key from the terminal, interrupt vector x01 at PL1
+
+    A recording logs every key the program is handed, and every ESC that interrupted it,
+    with its cycle: "lc3 keys 1" and then a line "cycle key" per key, the key in decimal or
+    "esc". A replay hands the keys over at the same cycles from the same state, as a
+    console does (a key arrives whether the last one was read or not), without reading the
+    terminal, so the run and its interrupts repeat exactly. No event is posted between
+    two keys, so the replay runs at full speed. A reset restarts a replay and ends a
+    recording.
+*/
+class KeyboardDevice : public Device
+{
+public:
+    static const int poll_interval = 256;   //instructions between two polls of an interactive console
+    static const int Key_Esc = -1;
+    int line;
+    FILE* record = NULL;                    //the log being written
+    std::vector<key_event> replay;          //the log replayed, from the start again after a reset
+    bool replaying = false;                 //keys come from replay, up to its end
+    size_t replay_pos = 0;
+    unsigned long long log_start = 0;       //cycle the recording or the replay started at
+    unsigned long long replay_next = ~0ULL; //cycle of the replay event posted
+
+    KeyboardDevice(Simulator& sim);
+    ~KeyboardDevice();
+    word read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //poll the console, or hand the program its next scripted or replayed key
+    void reset(Simulator& sim);
+    const char* name(){return "keyboard";}
+
+    bool start_record(Simulator& sim, const std::string& filename);
+    bool start_replay(Simulator& sim, const std::string& filename);    //false if the file cannot be read or is not a key log
+    void stop_record();
+    void stop_replay(Simulator& sim);       //back to the terminal
+
+private:
+    bool scripted(Simulator& sim);          //keys come from a non-interactive terminal, one after the other
+    void take_key(Simulator& sim, int key);
+    void next_replay(Simulator& sim);
+};
+
+//DSR xFE04, DDR xFE06: a character to the terminal
+class DisplayDevice : public Device
+{
+public:
+    word read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //the character has been printed
+    const char* name(){return "display";}
+};
+
+//TMSR xFE08, TMIR xFE0A: interval timer, interrupt vector x02 at the priority in TMSR
+class TimerDevice : public Device
+{
+public:
+    int line;
+    word gen = 0;                           //bumped whenever the timer is reprogrammed, so that stale expiries are dropped
+
+    TimerDevice(Simulator& sim);
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //expiry of the period started with gen == tag
+    void reset(Simulator& sim);
+    void start(Simulator& sim);
+    const char* name(){return "timer";}
+};
+
+//ICPR xFE10, ICMR xFE12: pending and enabled interrupt request lines
+class InterruptControllerDevice : public Device
+{
+public:
+    void write(Simulator& sim, word addr, word v);
+    const char* name(){return "interrupt controller";}
+};
+
+#endif // DEVICE_H_INCLUDED
@@ -0,0 +1,250 @@
+#include "diff.h"
+#include "sim.h"
+#include <cstring>
+#include <sstream>
+
+Engine::Engine() : sim(new Simulator())
+{
+    sim->initialize();
+    sim->term = &term;
+}
+
+Engine::~Engine()
+{
+}
+
+void Engine::step()
+{
+    sim->step_over();
+}
+
+void Engine::load(const Simulator& from)
+{
+    memcpy(sim->mem, from.mem, sizeof(sim->mem));
+    memcpy(sim->gen_reg, from.gen_reg, sizeof(sim->gen_reg));
+    sim->PC = from.PC;
+    sim->PSR = from.PSR;
+    sim->Saved_USP = from.Saved_USP;
+    sim->Saved_SSP = from.Saved_SSP;
+    sim->extensions = from.extensions;
+    sim->save_baseline();
+}
+
+void Engine::reset(const std::string& input)
+{
+    sim->fast_reset();
+    term.input = input;
+    term.input_pos = 0;
+    term.output.clear();
+}
+
+Engine* Engine::create(const std::string& name)
+{
+    if(name == "interp")
+        return new InterpEngine();
+    if(name == "probed")
+        return new ProbedEngine();
+    if(name == "aot")
+        return new TranslatedEngine();
+    if(name == "decoded")
+        return new DecodedEngine();
+    return NULL;
+}
+
+ProbedEngine::ProbedEngine()
+{
+    sim->add_probe(&probe);
+}
+
+void TranslatedEngine::step()
+{
+    runner.run(1);
+}
+
+void TranslatedEngine::load(const Simulator& from)
+{
+    Engine::load(from);
+    runner.attach();
+}
+
+void DecodedEngine::step()
+{
+    runner.run(1);
+}
+
+void DiffHarness::load(const Simulator& from)
+{
+    a->load(from);
+    b->load(from);
+}
+
+static bool is_control(word instr)
+{
+    switch(instr >> 12)
+    {
+    case 0: case 4: case 8: case 12: case 15:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_store(word instr)
+{
+    switch(instr >> 12)
+    {
+    case 3: case 7: case 11:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string DiffHarness::compare(bool memory, bool all)
+{
+    std::stringstream strm;
+    const Simulator& x = *a->sim;
+    const Simulator& y = *b->sim;
+    for(int r = 0; r < 8; r++)
+        if(x.gen_reg[r] != y.gen_reg[r])
+            strm << "  R" << r << ": " << Simulator::str_fulhex(x.gen_reg[r]) << " vs " << Simulator::str_fulhex(y.gen_reg[r]) << std::endl;
+    const char* names[] = {"PC", "PSR", "saved USP", "saved SSP"};
+    word xs[] = {x.PC, x.PSR, x.Saved_USP, x.Saved_SSP};
+    word ys[] = {y.PC, y.PSR, y.Saved_USP, y.Saved_SSP};
+    for(int i = 0; i < 4; i++)
+        if(xs[i] != ys[i])
+            strm << "  " << names[i] << ": " << Simulator::str_fulhex(xs[i]) << " vs " << Simulator::str_fulhex(ys[i]) << std::endl;
+    if(x.sim_status != y.sim_status)
+        strm << "  status: " << x.sim_status << " vs " << y.sim_status << std::endl;
+    if(a->term.output != b->term.output)
+        strm << "  display output: " << a->term.output.size() << " vs " << b->term.output.size() << " characters" << std::endl;
+
+    if(!memory)
+        return strm.str();
+
+    std::bitset<0x100> pages = x.dirty_pages | y.dirty_pages;
+    pages.set(0xfe);                    //device registers change without being marked
+    pages.set(0xff);
+    if(all)
+        pages.set();
+    int shown = 0;
+    for(int p = 0; p < 0x100; p++)
+    {
+        if(!pages[p] || memcmp(x.mem + (p << 8), y.mem + (p << 8), sizeof(word) * 0x100) == 0)
+            continue;
+        for(int i = p << 8; i < (p + 1) << 8; i++)
+            if(x.mem[i] != y.mem[i] && shown++ < 8)
+                strm << "  mem[" << Simulator::str_fulhex(i) << "]: " << Simulator::str_fulhex(x.mem[i]) << " vs " << Simulator::str_fulhex(y.mem[i]) << std::endl;
+    }
+    if(shown > 8)
+        strm << "  and " << shown - 8 << " more words" << std::endl;
+    return strm.str();
+}
+
+bool DiffHarness::lockstep(const std::string& input, long long max_steps, bool every_step, std::string& report)
+{
+    a->reset(input);
+    b->reset(input);
+    trail.clear();
+    for(steps = 0; steps < max_steps; )
+    {
+        word pc = a->sim->PC;
+        unsigned long long count = a->sim->HistoryCount;
+        a->step();
+        b->step();
+        steps++;
+        bool ran = a->sim->HistoryCount != count;       //otherwise the step entered an interrupt
+        if(ran)
+        {
+            trail.push_back(pc);
+            if(trail.size() > 8)
+                trail.erase(trail.begin());
+        }
+        bool stopped = a->sim->sim_status != Simulator::Normal || b->sim->sim_status != Simulator::Normal;
+        bool last = stopped || steps == max_steps;
+        bool block_end = last || !ran || is_control(a->sim->IR);
+        if(every_step || block_end)
+        {
+            report = compare(block_end || is_store(a->sim->IR), last);
+            if(!report.empty())
+                return false;
+        }
+        if(stopped)
+            break;
+    }
+    return true;
+}
+
+bool DiffHarness::run(const std::string& input, long long max_steps, std::string& report)
+{
+    if(lockstep(input, max_steps, !per_block, report))
+        return true;
+    if(per_block)
+    {
+        std::string first;
+        long long at = steps;
+        if(lockstep(input, at, true, first))            //the same run, compared at every step up to the divergence
+            steps = at;
+        else
+            report = first;
+    }
+
+    std::stringstream strm;
+    strm << "divergence at step " << steps << " between " << a->name() << " and " << b->name() << std::endl
+         << report << "last instructions of " << a->name() << ":" << std::endl;
+    for(size_t i = 0; i < trail.size(); i++)
+    {
+        std::vector<std::string> as = a->sim->instr_to_asm(a->sim->mem[trail[i]]);
+        strm << "  " << Simulator::str_fulhex(trail[i]) << "  " << as[0];
+        for(size_t k = 1; k < as.size(); k++)
+            strm << (k == 1 ? " " : ", ") << as[k];
+        strm << std::endl;
+    }
+    report = strm.str();
+    return false;
+}
+
+std::vector<word> random_program(std::mt19937& rng, int length)
+{
+    static const int ops[] = {1, 1, 1, 5, 5, 9, 0, 0, 0, 2, 3, 6, 7, 10, 11, 14, 4, 15};
+    std::vector<word> img;
+    img.push_back(0x3000);
+    for(int i = 0; i < length - 1; i++)
+    {
+        int dr = rng() % 8, sr = rng() % 8, target = rng() % length;
+        int r = rng() % 100;
+        int op = r == 0 ? 8 : r < 3 ? 12 : ops[rng() % (sizeof(ops) / sizeof(ops[0]))];
+        word w = op << 12;
+        switch(op)
+        {
+        case 0:         //BR inside the program
+            w |= (1 + rng() % 7) << 9 | ((target - i - 1) & 0x1ff);
+            break;
+        case 1: case 5:
+            w |= dr << 9 | sr << 6;
+            w |= rng() % 2 ? 0x20 | (rng() % 32) : rng() % 8;
+            break;
+        case 2: case 3: case 10: case 11: case 14:
+            w |= dr << 9 | (rng() % 0x200);
+            break;
+        case 4:         //JSR inside the program, sometimes JSRR
+            w |= rng() % 8 ? 0x0800 | ((target - i - 1) & 0x7ff) : sr << 6;
+            break;
+        case 6: case 7:
+            w |= dr << 9 | sr << 6 | (rng() % 0x40);
+            break;
+        case 9:
+            w |= dr << 9 | sr << 6 | 0x3f;
+            break;
+        case 12:
+            w |= sr << 6;
+            break;
+        case 15:        //OUT or HALT
+            w |= rng() % 4 ? 0x21 : 0x25;
+            break;
+        }
+        img.push_back(w);
+    }
+    img.push_back(0xf025);
+    return img;
+}
@@ -0,0 +1,105 @@
+#ifndef DIFF_H_INCLUDED
+#define DIFF_H_INCLUDED
+
+#include "decode.h"
+#include "probe.h"
+#include "terminal.h"
+#include "translate.h"
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+class Simulator;
+
+/*
+    An execution engine under differential test: a Simulator of its own, with its own
+    keyboard and display, advanced one step (an instruction or an interrupt entry) at a
+    time. A faster engine derives from it and overrides step().
+*/
+class Engine
+{
+public:
+    std::unique_ptr<Simulator> sim;
+    BufferTerminal term;
+
+    Engine();
+    virtual ~Engine();
+    virtual std::string name() = 0;
+    virtual void step();
+    virtual void load(const Simulator& from);   //copy the memory, CPU state and extension mode of from and make it the baseline
+    void reset(const std::string& input);       //back to the baseline, with this keyboard input
+
+    static Engine* create(const std::string& name);     //"interp", "probed", "aot", "decoded"; NULL if unknown
+};
+
+//the reference: the uninstrumented run loop
+class InterpEngine : public Engine
+{
+public:
+    std::string name() {return "interp";}
+};
+
+//the instrumented run loop, every load and store going through the device path
+class ProbedEngine : public Engine
+{
+public:
+    Probe probe;
+
+    ProbedEngine();
+    std::string name() {return "probed";}
+};
+
+//the ahead-of-time translations compiled in, the interpreter where none matches
+class TranslatedEngine : public Engine
+{
+public:
+    TranslatedRunner runner;
+
+    TranslatedEngine() : runner(*sim) {}
+    std::string name() {return "aot";}
+    void step();
+    void load(const Simulator& from);
+};
+
+//the predecoded pages of an in-process DecodeCache, the interpreter for the device events
+class DecodedEngine : public Engine
+{
+public:
+    DecodeCache cache;
+    TranslatedRunner runner;
+
+    DecodedEngine() : runner(*sim) {runner.cache = &cache;}
+    std::string name() {return "decoded";}
+    void step();
+};
+
+/*
+    Runs two engines in lockstep on the same image and input and compares R0-R7, PC, PSR,
+    the run status and the display output after every step, and every memory page either
+    has written after stores, control instructions and interrupts. The whole memory is
+    compared after the last step. With per_block nothing is compared after the other
+    instructions; a divergence found that way is replayed step by step to find the first
+    instruction that differs.
+*/
+class DiffHarness
+{
+public:
+    std::unique_ptr<Engine> a, b;
+    bool per_block = false;
+    long long steps = 0;                //run by the last run()
+
+    DiffHarness(Engine* _a, Engine* _b) : a(_a), b(_b) {}
+    void load(const Simulator& from);
+    bool run(const std::string& input, long long max_steps, std::string& report);     //false on a divergence, described in report
+
+private:
+    std::vector<word> trail;            //addresses of the last instructions run by a
+    bool lockstep(const std::string& input, long long max_steps, bool every_step, std::string& report);
+    std::string compare(bool memory, bool all);         //with the pages written, or all of them
+};
+
+//a random image for the harness: its origin, x3000, then length words of valid code ending in HALT
+std::vector<word> random_program(std::mt19937& rng, int length);
+
+#endif // DIFF_H_INCLUDED
@@ -0,0 +1,139 @@
+#include "disk.h"
+#include "sim.h"
+#include <algorithm>
+
+BlockDevice::BlockDevice(Simulator& sim, const std::string& filename)
+{
+    line = sim.add_irq("disk", 0x03, 0);
+    image = fopen(filename.c_str(), "r+b");
+    if(image == NULL)
+        image = fopen(filename.c_str(), "w+b");
+    io = std::thread(&BlockDevice::io_main, this);
+}
+
+BlockDevice::~BlockDevice()
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        quit = true;
+    }
+    cv.notify_all();
+    io.join();
+    if(image != NULL)
+        fclose(image);
+}
+
+void BlockDevice::io_main()
+{
+    std::unique_lock<std::mutex> g(lock);
+    while(true)
+    {
+        cv.wait(g, [this]{return has_job || quit;});
+        if(quit)
+            return;
+        bool failed = image == NULL || fseek(image, job_sector * sector_words * 2, SEEK_SET) != 0;
+        if(!failed && job_read)
+        {
+            size_t n = fread(&buffer[0], 1, buffer.size(), image);
+            std::fill(buffer.begin() + n, buffer.end(), 0);         //past the end of the image reads zeros
+            failed = ferror(image) != 0;
+            clearerr(image);
+        }
+        else if(!failed)
+            failed = fwrite(&buffer[0], 1, buffer.size(), image) != buffer.size() || fflush(image) != 0;
+        job_failed = failed;
+        has_job = false;
+        job_done = true;
+        cv.notify_all();
+    }
+}
+
+void BlockDevice::wait_job()
+{
+    std::unique_lock<std::mutex> g(lock);
+    cv.wait(g, [this]{return !has_job;});
+}
+
+void BlockDevice::start(Simulator& sim)
+{
+    word* mem = sim.mem;
+    dest = mem[BDMA];
+    int words = mem[BDCT] * sector_words;
+    int command = mem[BDSR] & 3;
+    mem[BDSR] &= 0xdffc;
+    if(command == 3 || words == 0 || dest + words > 0xfe00)
+    {
+        mem[BDSR] |= 0xa000;                    //done, with an error
+        sim.set_irq(line, Simulator::bit(mem[BDSR], 14));
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(lock);
+    buffer.resize(words * 2);
+    if(command == 2)
+        for(int i = 0; i < words; i++)
+        {
+            buffer[2*i] = mem[dest + i] >> 8;
+            buffer[2*i + 1] = mem[dest + i] & 0xff;
+        }
+    job_read = command == 1;
+    job_sector = mem[BDSN];
+    job_done = false;
+    has_job = true;
+    cv.notify_all();
+
+    mem[BDSR] |= 0x1000;                        //busy
+    gen++;
+    sim.schedule(this, (unsigned long long)mem[BDCT] * cycles_per_sector, gen);
+}
+
+word BlockDevice::read(Simulator& sim, word addr)
+{
+    if(addr == BDSR && Simulator::bit(sim.mem[addr], 12))
+        stalls++;
+    return sim.mem[addr];
+}
+
+void BlockDevice::write(Simulator& sim, word addr, word v)
+{
+    word* mem = sim.mem;
+    if(addr != BDSR)
+    {
+        mem[addr] = v;
+        return;
+    }
+    mem[BDSR] = (mem[BDSR] & 0x3000) | (v & 0x4703);
+    sim.set_irq_priority(line, Simulator::slice(v, 8, 11));
+    sim.set_irq(line, false);
+    if((v & 3) != 0 && !Simulator::bit(mem[BDSR], 12))
+        start(sim);
+    mem[BDSR] &= 0xfffc;
+}
+
+void BlockDevice::event(Simulator& sim, word tag)
+{
+    word* mem = sim.mem;
+    if(tag != gen || !Simulator::bit(mem[BDSR], 12))
+        return;
+    wait_job();
+    if(job_read && !job_failed)
+    {
+        //through the devices and probes, so that e.g. the framebuffer sees its tiles change
+        int words = buffer.size() / 2;
+        for(int i = 0; i < words; i++)
+            sim.dma_store(dest + i, (buffer[2*i] << 8) | buffer[2*i + 1]);
+    }
+    mem[BDSR] = (mem[BDSR] & 0x4700) | 0x8000 | (job_failed ? 0x2000 : 0);
+    sim.set_irq(line, Simulator::bit(mem[BDSR], 14));
+}
+
+void BlockDevice::reset(Simulator& sim)
+{
+    word* mem = sim.mem;
+    wait_job();
+    gen++;
+    if(Simulator::bit(mem[BDSR], 12))
+        mem[BDSR] &= 0xefff;                    //a transfer pending at the baseline is lost
+    sim.set_irq_priority(line, Simulator::slice(mem[BDSR], 8, 11));
+    sim.set_irq(line, Simulator::bit(mem[BDSR], 14) && Simulator::bit(mem[BDSR], 15));
+}
@@ -0,0 +1,69 @@
+#ifndef DISK_H_INCLUDED
+#define DISK_H_INCLUDED
+
+#include "device.h"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Block device on a host image file of 512-byte sectors (256 big-endian words each).
+
+    BDSR xFE20  [15] done, cleared by any write to BDSR   [14] interrupt enable
+                [13] error of the last transfer           [12] busy
+                [10:8] interrupt priority                 [1:0] command: 1 read, 2 write
+    BDSN xFE22  first sector
+    BDMA xFE24  memory address of the transfer
+    BDCT xFE26  number of sectors
+
+    Writing a command while the device is not busy starts a transfer. The file is read or
+    written on a background I/O thread while the program runs on; the transfer completes
+    cycles_per_sector instructions per sector later, when the data read is copied into
+    memory, BDSR[15] is set and the interrupt (vector x03) is raised. Completion is tied to
+    the instruction count, so runs are reproducible however fast the host disk is.
+*/
+class BlockDevice : public Device
+{
+public:
+    static const int BDSR = 0xfe20;
+    static const int BDSN = 0xfe22;
+    static const int BDMA = 0xfe24;
+    static const int BDCT = 0xfe26;
+    static const int sector_words = 256;
+    static const int cycles_per_sector = 256;
+
+    int line;
+
+    BlockDevice(Simulator& sim, const std::string& filename);
+    ~BlockDevice();
+    bool ok(){return image != NULL;}        //the image file is open
+
+    word read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //the transfer started with gen == tag completes
+    void reset(Simulator& sim);
+    const char* name(){return "disk";}
+
+private:
+    FILE* image;
+    word gen = 0;                           //bumped by every transfer, so that events of a cancelled one are dropped
+    word dest;                              //BDMA when the transfer started; the program may change BDMA meanwhile
+
+    //shared with the I/O thread
+    std::thread io;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool has_job = false, job_done = false, quit = false;
+    bool job_read, job_failed;
+    long job_sector;
+    std::vector<unsigned char> buffer;
+
+    void io_main();
+    void wait_job();
+    void start(Simulator& sim);
+};
+
+#endif // DISK_H_INCLUDED
@@ -0,0 +1,239 @@
+#include "framebuffer.h"
+#include "sim.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <vector>
+
+static void pixel_rgb(word p, unsigned char* rgb)
+{
+    for(int c = 0; c < 3; c++)
+    {
+        int v = (p >> (10 - 5*c)) & 0x1f;
+        rgb[c] = (v << 3) | (v >> 2);
+    }
+}
+
+static unsigned int crc32(const unsigned char* p, size_t n, unsigned int crc = 0)
+{
+    static unsigned int table[256];
+    static bool ready = false;
+    if(!ready)
+    {
+        for(unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int c = i;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for(size_t i = 0; i < n; i++)
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_u32(std::string& s, unsigned int v)
+{
+    s += (char)(v >> 24);
+    s += (char)(v >> 16);
+    s += (char)(v >> 8);
+    s += (char)v;
+}
+
+static void png_chunk(std::string& out, const char* type, const std::string& data)
+{
+    std::string body = type + data;
+    put_u32(out, data.size());
+    out += body;
+    put_u32(out, crc32((const unsigned char*)body.data(), body.size()));
+}
+
+//PNG without a compressor: the image data goes into stored deflate blocks
+static std::string encode_png(const std::vector<unsigned char>& rgb, int w, int h)
+{
+    std::string raw;
+    for(int y = 0; y < h; y++)
+    {
+        raw += '\0';                        //filter: none
+        raw.append((const char*)&rgb[y*w*3], w*3);
+    }
+
+    std::string z = "\x78\x01";
+    unsigned int a = 1, b = 0;
+    for(size_t i = 0; i < raw.size(); i++)
+    {
+        a = (a + (unsigned char)raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    for(size_t pos = 0; pos < raw.size(); pos += 65535)
+    {
+        size_t n = std::min<size_t>(65535, raw.size() - pos);
+        z += (char)(pos + n == raw.size() ? 1 : 0);
+        z += (char)(n & 0xff);
+        z += (char)(n >> 8);
+        z += (char)(~n & 0xff);
+        z += (char)((~n >> 8) & 0xff);
+        z.append(raw, pos, n);
+    }
+    put_u32(z, (b << 16) | a);
+
+    std::string ihdr;
+    put_u32(ihdr, w);
+    put_u32(ihdr, h);
+    ihdr += '\x08';                         //8-bit RGB
+    ihdr += '\x02';
+    ihdr.append(3, '\0');
+
+    std::string out = "\x89PNG\r\n\x1a\n";
+    png_chunk(out, "IHDR", ihdr);
+    png_chunk(out, "IDAT", z);
+    png_chunk(out, "IEND", "");
+    return out;
+}
+
+void FramebufferDevice::write(Simulator& sim, word addr, word v)
+{
+    sim.mem[addr] = v;
+    int i = addr - base;
+    if(i < width * height)
+    {
+        int t = (i / width / 8) * tiles_x + (i % width) / 8;
+        dirty_frame.set(t);
+        dirty_preview.set(t);
+    }
+}
+
+void FramebufferDevice::event(Simulator& sim, word tag)
+{
+    sim.schedule(this, frame_cycles);
+    frame(sim, false);
+}
+
+void FramebufferDevice::reset(Simulator& sim)
+{
+    dirty_frame.set();
+    dirty_preview.set();
+    sim.schedule(this, frame_cycles);
+}
+
+void FramebufferDevice::flush(Simulator& sim)
+{
+    frame(sim, true);
+}
+
+void FramebufferDevice::frame(Simulator& sim, bool force)
+{
+    if(dirty_frame.any() && pattern != "")
+    {
+        std::string filename;
+        if(frame_name(pattern, frames, filename) && save(sim, filename))
+            frames++;
+        dirty_frame.reset();
+    }
+    if(dirty_preview.any() && preview != NULL)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(force || !preview_drawn || std::chrono::duration<double>(now - last_preview).count() * preview_fps >= 1)
+        {
+            draw_preview(sim);
+            last_preview = now;
+        }
+    }
+}
+
+bool FramebufferDevice::frame_name(const std::string& pattern, int n, std::string& filename)
+{
+    //substituted here rather than by snprintf, the pattern being the user's
+    int conversions = 0;
+    filename.clear();
+    for(size_t i = 0; i < pattern.size(); i++)
+    {
+        if(pattern[i] != '%')
+        {
+            filename += pattern[i];
+            continue;
+        }
+        if(++i < pattern.size() && pattern[i] == '%')
+        {
+            filename += '%';
+            continue;
+        }
+        bool zero = i < pattern.size() && pattern[i] == '0';
+        if(zero)
+            i++;
+        int width = 0;
+        for(; i < pattern.size() && isdigit((unsigned char)pattern[i]) && width < 100; i++)
+            width = width * 10 + (pattern[i] - '0');
+        if(i >= pattern.size() || pattern[i] != 'd' || width >= 100 || ++conversions > 1)
+            return false;
+        std::string num = std::to_string(n);
+        if((int)num.size() < width)
+            num.insert(0, width - num.size(), zero ? '0' : ' ');
+        filename += num;
+    }
+    return conversions == 1;
+}
+
+bool FramebufferDevice::save(Simulator& sim, const std::string& filename)
+{
+    std::vector<unsigned char> rgb(width * height * 3);
+    for(int i = 0; i < width * height; i++)
+        pixel_rgb(sim.mem[base + i], &rgb[i*3]);
+
+    std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary);
+    if(!f)
+    {
+        sim.message() << "Cannot write " << filename << std::endl;
+        return false;
+    }
+    if(filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".png") == 0)
+        f << encode_png(rgb, width, height);
+    else
+    {
+        f << "P6\n" << width << " " << height << "\n255\n";
+        f.write((const char*)&rgb[0], rgb.size());
+    }
+    return (bool)f;
+}
+
+//two pixel rows per character: the upper half block in the colour of the upper pixel on the colour of the lower one
+void FramebufferDevice::draw_preview(Simulator& sim)
+{
+    std::string out;
+    char buf[64];
+    if(!preview_drawn)
+    {
+        out += "\x1b[2J";
+        dirty_preview.set();
+        preview_drawn = true;
+    }
+    for(int t = 0; t < tiles_x * tiles_y; t++)
+    {
+        if(!dirty_preview[t])
+            continue;
+        int x0 = (t % tiles_x) * 8, y0 = (t / tiles_x) * 8;
+        for(int y = y0; y < y0 + 8 && y < height; y += 2)
+        {
+            snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y/2 + 1, x0 + 1);
+            out += buf;
+            for(int x = x0; x < x0 + 8; x++)
+            {
+                unsigned char up[3], down[3] = {0, 0, 0};
+                pixel_rgb(sim.mem[base + y*width + x], up);
+                if(y + 1 < height)
+                    pixel_rgb(sim.mem[base + (y+1)*width + x], down);
+                snprintf(buf, sizeof(buf), "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm\xe2\x96\x80",
+                         up[0], up[1], up[2], down[0], down[1], down[2]);
+                out += buf;
+            }
+        }
+    }
+    snprintf(buf, sizeof(buf), "\x1b[0m\x1b[%d;1H", height/2 + 1);
+    out += buf;
+    fwrite(out.data(), 1, out.size(), preview);
+    fflush(preview);
+    dirty_preview.reset();
+}
@@ -0,0 +1,53 @@
+#ifndef FRAMEBUFFER_H_INCLUDED
+#define FRAMEBUFFER_H_INCLUDED
+
+#include "device.h"
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/*
+    Video memory at xC000-xFDFF: 128x124 pixels, one word each, row after row.
+    A pixel is [14:10] red, [9:5] green, [4:0] blue.
+
+    Stores mark 8x8 tiles dirty. Every frame_cycles instructions a frame is taken if any
+    tile changed since the last one: it is written to the file pattern (one %d, %0Nd or %Nd
+    for the frame number and %% for a percent sign, e.g. "out/frame%04d.ppm"; .png for PNG,
+    anything else for PPM) and drawn to the preview
+    stream, at most preview_fps times per second, redrawing only the dirty tiles.
+*/
+class FramebufferDevice : public Device
+{
+public:
+    static const int width = 128;
+    static const int height = 124;
+    static const int base = 0xc000;
+    static const int tiles_x = width / 8;
+    static const int tiles_y = (height + 7) / 8;
+
+    std::string pattern;                    //file name pattern of the frames; no files if empty
+    FILE* preview = NULL;                   //ANSI preview, e.g. stderr; none if NULL
+    double preview_fps = 10;
+    unsigned long long frame_cycles = 50000;
+    int frames = 0;                         //frames written
+
+    std::bitset<tiles_x * tiles_y> dirty_frame;     //tiles changed since the last frame file
+    std::bitset<tiles_x * tiles_y> dirty_preview;   //tiles changed since the last preview
+    bool preview_drawn = false;             //the preview screen has been cleared and drawn once
+    std::chrono::steady_clock::time_point last_preview;
+
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //take a frame
+    void reset(Simulator& sim);
+    void flush(Simulator& sim);             //take the last frame now, ignoring the frame rate
+    bool save(Simulator& sim, const std::string& filename);    //write the screen as .png or .ppm
+    static bool frame_name(const std::string& pattern, int n, std::string& filename);  //false if pattern is not one of the above
+    const char* name(){return "framebuffer";}
+
+private:
+    void frame(Simulator& sim, bool force);
+    void draw_preview(Simulator& sim);
+};
+
+#endif // FRAMEBUFFER_H_INCLUDED
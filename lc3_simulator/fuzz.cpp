@@ -0,0 +1,284 @@
+#include "fuzz.h"
+#include "sim.h"
+#include "terminal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+CoverageProbe::CoverageProbe()
+{
+    clear();
+}
+
+void CoverageProbe::clear()
+{
+    memset(map, 0, sizeof(map));
+    fault = No_Fault;
+    fault_pc = pc = 0;
+    from = 0;
+    pending = false;
+}
+
+void CoverageProbe::fetch(Simulator& sim, word addr)
+{
+    if(pending)
+    {
+        unsigned char& c = map[(from ^ addr) & (map_size - 1)];
+        if(c < 255)
+            c++;
+        pending = false;
+    }
+    pc = addr;
+    if(fault == No_Fault && (addr >= 0xfe00 || sim.mem[addr] == 0))
+    {
+        fault = Runaway;
+        fault_pc = addr;
+    }
+}
+
+void CoverageProbe::read(Simulator& sim, word addr)
+{
+    //polling the keyboard when no key is left: the program waits for input it will never get
+    if(addr == Simulator::KBSR_ && fault == No_Fault && !Simulator::bit(sim.mem[Simulator::KBSR_], 15)
+       && sim.term != NULL && !sim.term->kbhit())
+    {
+        fault = Starved;
+        fault_pc = pc;
+    }
+}
+
+void CoverageProbe::retire(Simulator& sim, word addr)
+{
+    word instr = sim.IR;
+    switch(instr >> 12)
+    {
+    case 0:
+        if((instr & 0x0e00) == 0)
+            break;
+        //fall through
+    case 4: case 8: case 12: case 15:
+        from = (addr * 0x9e3779b1u) >> 19;
+        pending = true;
+        break;
+    case 13:
+        if(!sim.extensions && fault == No_Fault)
+        {
+            fault = Illegal_Opcode;
+            fault_pc = addr;
+        }
+        break;
+    }
+    if(fault != No_Fault)
+        sim.sim_status = Simulator::User_Interrupt;
+}
+
+void CoverageProbe::interrupt(Simulator& sim, word vector)
+{
+    from = ((0x10000u + vector) * 0x9e3779b1u) >> 19;
+    pending = true;
+}
+
+//hit counts are compared by class: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static unsigned char count_class(unsigned char c)
+{
+    if(c <= 3)
+        return c == 3 ? 4 : c;
+    if(c <= 7)
+        return 8;
+    if(c <= 15)
+        return 16;
+    if(c <= 31)
+        return 32;
+    return c <= 127 ? 64 : 128;
+}
+
+Fuzzer::Fuzzer(Simulator& s, BufferTerminal& t, const fuzz_config& c)
+    : cfg(c), sim(s), term(t), virgin(CoverageProbe::map_size, 0), rng(c.seed)
+{
+    sim.add_probe(&cov);
+}
+
+Fuzzer::~Fuzzer()
+{
+    sim.remove_probe(&cov);
+}
+
+Fuzzer::outcome Fuzzer::execute(const std::string& input, word& site)
+{
+    sim.fast_reset();
+    term.input = input;
+    term.input_pos = 0;
+    term.output.clear();
+    cov.clear();
+    sim.run(cfg.max_steps);
+    execs++;
+
+    if(cov.fault == CoverageProbe::Runaway || cov.fault == CoverageProbe::Illegal_Opcode)
+    {
+        site = cov.fault_pc;
+        return Crashed;
+    }
+    if(sim.sim_status == Simulator::Priviledge_Exception)
+    {
+        site = cov.pc;
+        return Crashed;
+    }
+    if(sim.sim_status == Simulator::Normal)
+    {
+        site = cov.pc;
+        return Hung;
+    }
+    return Passed;
+}
+
+bool Fuzzer::new_coverage()
+{
+    bool fresh = false;
+    for(int i = 0; i < CoverageProbe::map_size; i += 8)
+    {
+        unsigned long long chunk;
+        memcpy(&chunk, cov.map + i, 8);
+        if(chunk == 0)
+            continue;
+        for(int k = i; k < i + 8; k++)
+        {
+            unsigned char c = count_class(cov.map[k]);
+            if(c & ~virgin[k])
+            {
+                virgin[k] |= c;
+                fresh = true;
+            }
+        }
+    }
+    return fresh;
+}
+
+std::string Fuzzer::mutate(const std::string& input)
+{
+    static const char* interesting[] = {"\n", " ", "0", "9", "-", "a", "z", "A", "Z", "\x1b", "\x7f", "\xff"};
+    std::string s = input;
+    int n = 1 + rng() % 4;
+    for(int k = 0; k < n; k++)
+    {
+        size_t pos = rng() % (s.size() + 1), len = 1 + rng() % 8;
+        switch(rng() % 7)
+        {
+        case 0:         //flip a bit
+            if(!s.empty())
+                s[pos % s.size()] ^= 1 << (rng() % 8);
+            break;
+        case 1:         //a printable character
+            if(!s.empty())
+                s[pos % s.size()] = 0x20 + rng() % 0x5f;
+            break;
+        case 2:
+            s.insert(pos, interesting[rng() % (sizeof(interesting) / sizeof(interesting[0]))]);
+            break;
+        case 3:
+            s.erase(std::min(pos, s.size()), len);
+            break;
+        case 4:         //repeat a piece
+            if(!s.empty())
+            {
+                size_t from = rng() % s.size();
+                s.insert(pos, s.substr(from, len * 2));
+            }
+            break;
+        case 5:         //splice with another input
+        {
+            const std::string& other = corpus[rng() % corpus.size()];
+            size_t cut = rng() % (other.size() + 1);
+            s = s.substr(0, pos) + other.substr(cut);
+            break;
+        }
+        case 6:         //a number
+            s.insert(pos, std::to_string((int)(rng() % 65536) - 32768));
+            break;
+        }
+    }
+    if(s.size() > cfg.max_len)
+        s.resize(cfg.max_len);
+    return s;
+}
+
+std::string Fuzzer::minimize(const std::string& input, outcome kind, word site)
+{
+    std::string best = input;
+    for(size_t chunk = std::max<size_t>(best.size() / 2, 1); ; chunk /= 2)
+    {
+        for(size_t pos = 0; pos < best.size(); )
+        {
+            std::string trial = best;
+            trial.erase(pos, chunk);
+            word s;
+            if(execute(trial, s) == kind && (kind == Hung || s == site))     //a loop may run out of steps anywhere in it
+                best = trial;
+            else
+                pos += chunk;
+        }
+        if(chunk == 1)
+            break;
+    }
+    return best;
+}
+
+void Fuzzer::save(const std::string& input, outcome kind, word site)
+{
+    if(!found.insert(std::make_pair((int)kind, site)).second)
+        return;
+    (kind == Crashed ? crashes : hangs)++;
+    std::string small = minimize(input, kind, site);
+    std::string filename = cfg.out_dir + "/" + (kind == Crashed ? "crash-" : "hang-") + Simulator::str_fulhex(site);
+    std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary);
+    f << small;
+    fprintf(stderr, "%s at %s, %d-byte input: %s%s\n", kind == Crashed ? "crash" : "hang", Simulator::str_fulhex(site).c_str(),
+            (int)small.size(), filename.c_str(), f ? "" : " (cannot write)");
+}
+
+void Fuzzer::fuzz(const std::vector<std::string>& seeds)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::string> initial = seeds;
+    if(initial.empty())
+        initial.push_back("");
+    for(size_t i = 0; i < initial.size(); i++)
+    {
+        word site;
+        outcome o = execute(initial[i], site);
+        bool fresh = new_coverage();
+        if(o != Passed)
+            save(initial[i], o, site);
+        else if(fresh || corpus.empty())
+            corpus.push_back(initial[i]);
+    }
+    if(corpus.empty())
+        corpus.push_back("");
+
+    while(execs < (unsigned long long)cfg.runs)
+    {
+        std::string child = mutate(corpus[rng() % corpus.size()]);
+        word site;
+        outcome o = execute(child, site);
+        bool fresh = new_coverage();
+        if(o != Passed)
+            save(child, o, site);
+        else if(fresh)
+            corpus.push_back(child);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string Fuzzer::report() const
+{
+    int edges = 0;
+    for(size_t i = 0; i < virgin.size(); i++)
+        edges += virgin[i] != 0;
+    std::stringstream strm;
+    strm << "fuzz: " << execs << " runs in " << (int)(seconds * 1000) << " ms (" << (long long)(seconds > 0 ? execs / seconds : 0)
+         << " runs/s), corpus " << corpus.size() << ", edges " << edges
+         << ", crashes " << crashes << ", hangs " << hangs << std::endl;
+    return strm.str();
+}
@@ -0,0 +1,93 @@
+#ifndef FUZZ_H_INCLUDED
+#define FUZZ_H_INCLUDED
+
+#include "probe.h"
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BufferTerminal;
+
+/*
+    Edge coverage of a run: every control instruction (BR taken or not, JMP, JSR, JSRR,
+    TRAP, RTI) and every interrupt entry counts the edge from its address to the next
+    instruction fetched, in a byte map indexed by a hash of the pair.
+
+    The probe also stops the run, by setting sim_status, when the program crashes or
+    waits for keyboard input that will never come.
+*/
+class CoverageProbe : public Probe
+{
+public:
+    static const int map_size = 1 << 13;
+    unsigned char map[map_size];
+
+    enum fault_kind {No_Fault, Runaway, Illegal_Opcode, Starved};
+    fault_kind fault = No_Fault;        //why the probe stopped the run
+    word fault_pc = 0;                  //where
+    word pc = 0;                        //address of the last instruction fetched
+
+    CoverageProbe();
+    void clear();                       //before each run
+    void fetch(Simulator& sim, word addr);
+    void read(Simulator& sim, word addr);
+    void retire(Simulator& sim, word addr);
+    void interrupt(Simulator& sim, word vector);
+
+private:
+    unsigned int from = 0;              //hash of the last control transfer
+    bool pending = false;               //the next fetch ends an edge
+};
+
+struct fuzz_config
+{
+    long long max_steps = 100000;       //per run; reaching it is a hang
+    long long runs = 100000;
+    size_t max_len = 1024;              //of an input
+    unsigned int seed = 1;
+    std::string out_dir = ".";          //where crash-* and hang-* inputs are saved
+};
+
+/*
+    Coverage-guided fuzzer of the keyboard input: a corpus of inputs, each of which found
+    new edges or a new edge hit count, is mutated and run again. Every run starts from the
+    baseline of fast_reset(), so the program must be loaded and the baseline saved first.
+
+    Runs that end in a privilege exception, an illegal opcode or execution of empty memory
+    or device registers are crashes; runs that use up max_steps are hangs. The first input
+    of each kind and address is minimized and saved.
+*/
+class Fuzzer
+{
+public:
+    enum outcome {Passed, Crashed, Hung};
+
+    fuzz_config cfg;
+    std::vector<std::string> corpus;
+    unsigned long long execs = 0;
+    int crashes = 0, hangs = 0;
+    double seconds = 0;                         //spent in fuzz()
+
+    Fuzzer(Simulator& s, BufferTerminal& t, const fuzz_config& c);
+    ~Fuzzer();
+    outcome execute(const std::string& input, word& site);     //one run; site is where it crashed or hung
+    void fuzz(const std::vector<std::string>& seeds);
+    std::string minimize(const std::string& input, outcome kind, word site);
+    std::string report() const;
+
+private:
+    Simulator& sim;
+    BufferTerminal& term;
+    CoverageProbe cov;
+    std::vector<unsigned char> virgin;          //hit-count classes of every edge seen so far
+    std::set<std::pair<int, word> > found;      //crash and hang sites already saved
+    std::mt19937 rng;
+
+    bool new_coverage();
+    std::string mutate(const std::string& input);
+    void save(const std::string& input, outcome kind, word site);
+};
+
+#endif // FUZZ_H_INCLUDED
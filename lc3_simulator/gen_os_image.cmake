@@ -0,0 +1,51 @@
+# Converts an ASCII .bin image (first line: start address, then one 16-bit word per line)
+# into a C++ header with the words as a constexpr array.
+#
+#   cmake -DIN=lc3sys_mem.bin -DOUT=os_image.h -P gen_os_image.cmake
+
+if(NOT IN OR NOT OUT)
+    message(FATAL_ERROR "usage: cmake -DIN=<image.bin> -DOUT=<header.h> -P gen_os_image.cmake")
+endif()
+
+file(STRINGS "${IN}" lines)
+list(LENGTH lines count)
+if(count LESS 1)
+    message(FATAL_ERROR "${IN}: empty image")
+endif()
+
+set(body "")
+set(n 0)
+set(start "")
+foreach(line IN LISTS lines)
+    string(STRIP "${line}" line)
+    if(line STREQUAL "")
+        continue()
+    endif()
+    if(NOT line MATCHES "^[01][01][01][01][01][01][01][01][01][01][01][01][01][01][01][01]$")
+        message(FATAL_ERROR "${IN}: format error at \"${line}\"")
+    endif()
+    if(start STREQUAL "")
+        set(start "0b${line}")
+    else()
+        string(APPEND body "    0b${line},\n")
+        math(EXPR n "${n} + 1")
+    endif()
+endforeach()
+
+get_filename_component(name "${IN}" NAME)
+file(WRITE "${OUT}.tmp"
+"// Generated from ${name} by gen_os_image.cmake. Do not edit.
+#ifndef OS_IMAGE_H_INCLUDED
+#define OS_IMAGE_H_INCLUDED
+
+constexpr unsigned short int os_image_start = ${start};
+constexpr unsigned short int os_image_size = ${n};
+constexpr unsigned short int os_image[${n}] =
+{
+${body}};
+
+#endif // OS_IMAGE_H_INCLUDED
+")
+# only touch the header when the image changed, so the simulator is not rebuilt needlessly
+execute_process(COMMAND "${CMAKE_COMMAND}" -E copy_if_different "${OUT}.tmp" "${OUT}")
+file(REMOVE "${OUT}.tmp")
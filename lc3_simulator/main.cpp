@@ -1,88 +1,91 @@
-#include <iostream>
-#include "sim.h"
-#include <stdlib.h>
-#include <stdio.h>
-
-using namespace std;
-
-int main()
-{
-    Simulator sim;
-    sim.initialize();
-    char cmdstr[50];
-
-    system("mode con cols=90");
-
-    while(true)
-    {
-        system("cls");
-        sim.show_status();
-        sim.show_mem();
-        sim.show_message();
-        printf("\n");
-        sim.text_color(0x80);
-        printf("Command:");
-        sim.text_color(0x07);
-        if(!cin.getline(cmdstr, 50))
-            continue;
-        if(!sim.cmd(cmdstr))
-        {
-            continue;
-        }
-        if(sim.sim_status == sim.status_code::Exit)
-            break;
-        else if(sim.sim_status == sim.status_code::Select)
-        {
-            bool changed_flag = true;           //not to refresh the window every time.
-            int ch;
-            sim.vselect = sim.vstart+1;
-            sim.vtrackPC = false;
-            while (1)
-            {
-                if(changed_flag)
-                {
-                    system("cls");
-                    sim.show_status();
-                    sim.show_mem();
-                    sim.show_message();
-                    changed_flag = false;
-                }
-                if (_kbhit()){
-                    ch = _getch();
-                    if(ch==22472||ch=='w')
-                    {
-                        if(sim.vselect>0)sim.vselect--;
-                        if(sim.vselect<sim.vstart+2 && sim.vstart>0)sim.vstart--;
-                        changed_flag =  true;
-                    }
-                    else if(ch==22480||ch=='s')
-                    {
-                        if(sim.vselect<0xfffe)sim.vselect++;
-                        if(sim.vselect>sim.vstart+23 && sim.vstart<0xfffe)sim.vstart++;
-                        changed_flag =  true;
-                    }
-                    else if (ch == 27)
-                    {
-                        sim.sim_status = sim.status_code::Normal;
-                        break;
-                    }
-                    if((!sim.isNOP(sim.mem[sim.vselect]))&&sim.slice(sim.mem[sim.vselect],12,16)==0)
-                    {
-                        sim.vjump = sim.vselect + sim.sign_extend(sim.slice(sim.mem[sim.vselect],0,9),9) +1;
-                    }
-                    else
-                    {
-                        sim.vjump = -1;
-                    }
-                }
-            }
-        }
-        else if(sim.sim_status == sim.status_code::User_Interrupt)
-        {
-            printf("\n Program was interrupted by pressing ESC. Press Enter to back to CMD mode.");
-            cin.getline(cmdstr, 50);
-        }
-    }
-    system("pause");
-    return 0;
-}
+#include <iostream>
+#include "sim.h"
+#include "view.h"
+#include "terminal.h"
+#include "batch.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if(is_batch_args(argc, argv))
+        return run_batch(argc, argv);
+
+    Terminal* term = create_console_terminal();
+    Simulator sim;
+    sim.initialize();
+    sim.term = term;
+    SimView view(sim, *term);
+    char cmdstr[256];
+
+    while(true)
+    {
+        view.refresh();
+        printf("\n");
+        term->text_color(0x80);
+        printf("Command:");
+        term->text_color(0x07);
+        if(!term->getline(cmdstr, 256))
+            continue;
+        if(!view.cmd(cmdstr) && !sim.cmd(cmdstr))
+        {
+            continue;
+        }
+        if(sim.sim_status == sim.status_code::Exit)
+            break;
+        else if(sim.sim_status == sim.status_code::Select)
+        {
+            bool changed_flag = true;           //not to refresh the window every time.
+            int ch;
+            view.vselect = view.vstart+1;
+            view.vtrackPC = false;
+            while (1)
+            {
+                if(changed_flag)
+                {
+                    view.refresh();
+                    changed_flag = false;
+                }
+                if (term->kbhit()){
+                    ch = term->getch();
+                    if(ch==22472||ch=='w')
+                    {
+                        if(view.vselect>0)view.vselect--;
+                        if(view.vselect<view.vstart+2 && view.vstart>0)view.vstart--;
+                        changed_flag =  true;
+                    }
+                    else if(ch==22480||ch=='s')
+                    {
+                        if(view.vselect<0xfffe)view.vselect++;
+                        if(view.vselect>view.vstart+23 && view.vstart<0xfffe)view.vstart++;
+                        changed_flag =  true;
+                    }
+                    else if (ch == 27)
+                    {
+                        sim.sim_status = sim.status_code::Normal;
+                        break;
+                    }
+                    word target;
+                    if((sim.slice(sim.mem[view.vselect],12,16)==0||sim.slice(sim.mem[view.vselect],12,16)==4) && sim.pc_target(view.vselect, sim.mem[view.vselect], target))
+                    {
+                        view.vjump = target;
+                    }
+                    else
+                    {
+                        view.vjump = -1;
+                    }
+                }
+            }
+        }
+        else if(sim.sim_status == sim.status_code::User_Interrupt)
+        {
+            printf("\n Program was interrupted by pressing ESC. Press Enter to back to CMD mode.");
+            term->getline(cmdstr, 256);
+        }
+    }
+    term->pause();
+    delete term;
+    return 0;
+}
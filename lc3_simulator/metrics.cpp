@@ -0,0 +1,135 @@
+#include "metrics.h"
+#include "sim.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+void sim_metrics::reset()
+{
+    memset(this, 0, sizeof(*this));
+}
+
+MetricsRegistry::family& MetricsRegistry::add(const std::string& name, const std::string& type, const std::string& help)
+{
+    family f;
+    f.name = name;
+    f.type = type;
+    f.help = help;
+    families.push_back(f);
+    return families.back();
+}
+
+static void put(MetricsRegistry::family& f, const std::string& labels, double value)
+{
+    MetricsRegistry::sample s = {labels, value};
+    f.samples.push_back(s);
+}
+
+void MetricsRegistry::collect(const Simulator& sim)
+{
+    static const char* opcodes[16] = {"BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+                                      "RTI", "NOT", "LDI", "STI", "JMP", "reserved", "LEA", "TRAP"};
+    const sim_metrics& m = sim.metrics;
+    families.clear();
+
+    family& ops = add("lc3_instructions_total", "counter", "Instructions executed, by opcode.");
+    for(int i = 0; i < 16; i++)
+        put(ops, std::string("opcode=\"") + opcodes[i] + "\"", m.opcodes[i]);
+
+    family& br = add("lc3_branches_total", "counter", "Conditional branches, by outcome.");
+    put(br, "outcome=\"taken\"", m.branches_taken);
+    put(br, "outcome=\"not_taken\"", m.opcodes[0] - m.branches_taken);
+
+    family& traps = add("lc3_traps_total", "counter", "TRAP instructions, by vector.");
+    for(int v = 0; v < 256; v++)
+        if(m.traps[v])
+            put(traps, "vector=\"" + Simulator::str_fulhex(v) + "\"", m.traps[v]);
+
+    family& irqs = add("lc3_interrupts_total", "counter", "Interrupts taken, by request line.");
+    for(int i = 0; i < sim.irq_count; i++)
+        put(irqs, std::string("line=\"") + sim.irq[i].name + "\"", sim.irq[i].taken);
+
+    family& reads = add("lc3_memory_reads_total", "counter", "Data loads, by 4K-word region.");
+    family& writes = add("lc3_memory_writes_total", "counter", "Data stores, by 4K-word region.");
+    for(int r = 0; r < 16; r++)
+    {
+        std::string region = "region=\"" + Simulator::str_fulhex(r << 12) + "\"";
+        if(m.reads[r])
+            put(reads, region, m.reads[r]);
+        if(m.writes[r])
+            put(writes, region, m.writes[r]);
+    }
+
+    family& stalls = add("lc3_device_stalls_total", "counter", "Status register polls that found the device not ready.");
+    for(size_t i = 0; i < sim.devices.size(); i++)
+        put(stalls, std::string("device=\"") + sim.devices[i]->name() + "\"", sim.devices[i]->stalls);
+
+    put(add("lc3_cycles", "gauge", "Device clock since the last reset."), "", sim.cycle);
+    put(add("lc3_run_seconds_total", "counter", "Wall-clock time spent running."), "", m.run_ns / 1e9);
+    put(add("lc3_run_instructions_total", "counter", "Instructions executed while running."), "", m.run_instructions);
+    put(add("lc3_mips", "gauge", "Millions of instructions per second of running."), "",
+        m.run_ns ? m.run_instructions * 1000.0 / m.run_ns : 0);
+}
+
+std::string MetricsRegistry::prometheus() const
+{
+    std::stringstream strm;
+    strm.precision(15);
+    for(size_t i = 0; i < families.size(); i++)
+    {
+        const family& f = families[i];
+        strm << "# HELP " << f.name << " " << f.help << std::endl
+             << "# TYPE " << f.name << " " << f.type << std::endl;
+        for(size_t k = 0; k < f.samples.size(); k++)
+        {
+            strm << f.name;
+            if(!f.samples[k].labels.empty())
+                strm << "{" << f.samples[k].labels << "}";
+            strm << " " << f.samples[k].value << std::endl;
+        }
+    }
+    return strm.str();
+}
+
+//name="value" labels as a JSON object
+static std::string json_labels(const std::string& labels)
+{
+    std::string s = "{";
+    size_t pos = 0;
+    while(pos < labels.size())
+    {
+        size_t eq = labels.find('=', pos), end = labels.find('"', eq + 2);
+        if(s.size() > 1)
+            s += ", ";
+        s += "\"" + labels.substr(pos, eq - pos) + "\": " + labels.substr(eq + 1, end - eq);
+        pos = end + 2;                  //past the quote and the comma
+    }
+    return s + "}";
+}
+
+std::string MetricsRegistry::json() const
+{
+    std::stringstream strm;
+    strm.precision(15);
+    strm << "{" << std::endl;
+    for(size_t i = 0; i < families.size(); i++)
+    {
+        const family& f = families[i];
+        strm << "  \"" << f.name << "\": {\"type\": \"" << f.type << "\", \"help\": \"" << f.help << "\", \"samples\": [";
+        for(size_t k = 0; k < f.samples.size(); k++)
+            strm << (k ? ", " : "") << "{\"labels\": " << json_labels(f.samples[k].labels) << ", \"value\": " << f.samples[k].value << "}";
+        strm << "]}" << (i + 1 < families.size() ? "," : "") << std::endl;
+    }
+    strm << "}" << std::endl;
+    return strm.str();
+}
+
+bool MetricsRegistry::save(const std::string& filename) const
+{
+    std::ofstream f(filename.c_str(), std::ios::out | std::ios::binary);
+    if(!f.is_open())
+        return false;
+    bool prom = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".prom") == 0;
+    f << (prom ? prometheus() : json());
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+class Simulator;
+
+/*
+    Counters the core keeps while it runs. They belong to one Simulator, which runs on one
+    thread, so they are plain integers: an increment on the hot path costs an add to a line
+    already in cache. They accumulate from initialize(); fast_reset() keeps them.
+*/
+struct sim_metrics
+{
+    unsigned long long opcodes[16];             //instructions by opcode
+    unsigned long long branches_taken;          //BR; the not taken are opcodes[0] minus these
+    unsigned long long traps[256];              //TRAP by vector
+    unsigned long long reads[16], writes[16];   //data accesses by 4K-word region
+    unsigned long long run_ns;                  //wall-clock time spent in run()
+    unsigned long long run_instructions;        //instructions executed by run()
+
+    void reset();
+};
+
+/*
+    A snapshot of the metrics of a simulator, its interrupt lines and its devices, as
+    metric families in the Prometheus data model, exported as JSON or as Prometheus text.
+*/
+class MetricsRegistry
+{
+public:
+    struct sample
+    {
+        std::string labels;                     //in exposition syntax, e.g. opcode="ADD"; may be empty
+        double value;
+    };
+    struct family
+    {
+        std::string name, type, help;           //type: counter or gauge
+        std::vector<sample> samples;
+    };
+    std::vector<family> families;
+
+    family& add(const std::string& name, const std::string& type, const std::string& help);
+    void collect(const Simulator& sim);
+    std::string json() const;
+    std::string prometheus() const;
+    bool save(const std::string& filename) const;       //Prometheus text if the name ends in .prom, JSON otherwise
+};
+
+#endif // METRICS_H_INCLUDED
@@ -0,0 +1,25 @@
+#ifndef PROBE_H_INCLUDED
+#define PROBE_H_INCLUDED
+
+typedef unsigned short int word;
+
+class Simulator;
+
+/*
+    Instrumentation attached with Simulator::add_probe(). While a probe is attached the
+    simulator runs an instrumented instantiation of its step and sends every load and store
+    through load_io()/store_io(); without probes none of the hooks below is compiled in
+    the run loop.
+*/
+class Probe
+{
+public:
+    virtual ~Probe(){}
+    virtual void fetch(Simulator& sim, word addr){}        //the instruction at addr is fetched
+    virtual void read(Simulator& sim, word addr){}         //a data load
+    virtual void write(Simulator& sim, word addr){}        //a data store
+    virtual void retire(Simulator& sim, word addr){}       //the instruction fetched from addr, now in IR, has executed
+    virtual void interrupt(Simulator& sim, word vector){}  //an interrupt is entered
+};
+
+#endif // PROBE_H_INCLUDED
@@ -0,0 +1,386 @@
+#include "server.h"
+#include "batch.h"
+#include "sim.h"
+#include "terminal.h"
+#include <cstdio>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t max_frame = 16 << 20;
+static const int write_timeout = 10000;         //ms a client may leave its response unread
+
+//a request read by the main thread, and the connection to answer on
+struct job
+{
+    int fd;
+    std::string request;
+};
+
+//requests waiting for a worker
+class job_queue
+{
+public:
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<job> jobs;
+    int done = -1;                      //write end of the pipe on which workers hand connections back
+
+    void push(const job& j)
+    {
+        std::lock_guard<std::mutex> g(lock);
+        jobs.push_back(j);
+        ready.notify_one();
+    }
+    job pop()
+    {
+        std::unique_lock<std::mutex> g(lock);
+        ready.wait(g, [this]{return !jobs.empty();});
+        job j = jobs.front();
+        jobs.pop_front();
+        return j;
+    }
+};
+
+//a client connection, owned by the main thread
+struct connection
+{
+    std::string in;                     //bytes read and not yet taken as requests
+    bool busy = false;                  //a request of it is queued or running; the next one waits
+};
+
+//on a non-blocking socket, waiting at most write_timeout for the client to make room
+static bool write_all(int fd, const void* buf, size_t n)
+{
+    const char* p = (const char*)buf;
+    while(n > 0)
+    {
+        ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            pollfd pfd = {fd, POLLOUT, 0};
+            if(poll(&pfd, 1, write_timeout) <= 0)
+                return false;
+            continue;
+        }
+        if(r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static unsigned int get_u32(const unsigned char* p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static void put_u32(std::string& s, unsigned int v)
+{
+    s += (char)(v >> 24);
+    s += (char)(v >> 16);
+    s += (char)(v >> 8);
+    s += (char)v;
+}
+
+static void put_field(std::string& s, char tag, const std::string& v)
+{
+    s += tag;
+    put_u32(s, v.size());
+    s += v;
+}
+
+//take the next request of c, if it is all there; false if its frame is too long
+static bool take_frame(connection& c, std::string& payload, bool& whole)
+{
+    whole = false;
+    if(c.in.size() < 4)
+        return true;
+    size_t n = get_u32((const unsigned char*)c.in.data());
+    if(n > max_frame)
+        return false;
+    if(c.in.size() - 4 < n)
+        return true;
+    payload = c.in.substr(4, n);
+    c.in.erase(0, 4 + n);
+    whole = true;
+    return true;
+}
+
+//run one job on a warm simulator and build the response payload
+static std::string run_job(Simulator& sim, BufferTerminal& term, const std::string& req, long long default_steps)
+{
+    std::string resp;
+    std::string error;
+    long long steps = default_steps;
+    word start_pc = 0x3000;
+    bool has_pc = false, loaded = false;
+
+    sim.fast_reset();
+    sim.message().str("");
+    term.input.clear();
+    term.input_pos = 0;
+    term.output.clear();
+
+    size_t pos = 0;
+    while(error.empty() && pos < req.size())
+    {
+        if(req.size() - pos < 5)
+        {
+            error = "truncated field";
+            break;
+        }
+        char tag = req[pos];
+        size_t n = get_u32((const unsigned char*)req.data() + pos + 1);
+        pos += 5;
+        if(n > req.size() - pos)
+        {
+            error = "truncated field";
+            break;
+        }
+        std::string v = req.substr(pos, n);
+        pos += n;
+        try
+        {
+            switch(tag)
+            {
+            case 'B':
+                if(!sim.load_bin_text(v))
+                    error = sim.message().str();
+                else if(!loaded && !has_pc)
+                    start_pc = sim.load_origin;
+                loaded = true;
+                break;
+            case 'I':
+                term.input = v;
+                break;
+            case 'S':
+                steps = atoll(v.c_str());
+                break;
+            case 'P':
+                start_pc = sim.to_word(v);
+                has_pc = true;
+                break;
+            default:
+                error = std::string("unknown field '") + tag + "'";
+            }
+        }
+        catch(int ex)
+        {
+            error = "cannot recognize " + v;
+        }
+    }
+    if(error.empty() && !loaded)
+        error = "no program";
+    if(!error.empty())
+    {
+        put_field(resp, 'X', std::to_string((int)Batch_Error));
+        put_field(resp, 'E', error);
+        return resp;
+    }
+
+    sim.PC = start_pc;
+    sim.run(steps);
+
+    put_field(resp, 'X', std::to_string(batch_status(sim)));
+    put_field(resp, 'O', term.output);
+    put_field(resp, 'R', dump_regs(sim));
+    put_field(resp, 'N', std::to_string(sim.HistoryCount));
+    return resp;
+}
+
+static void worker_main(job_queue* queue, long long default_steps)
+{
+    std::unique_ptr<Simulator> sim(new Simulator());
+    BufferTerminal term;
+    sim->initialize();
+    sim->term = &term;
+
+    while(true)
+    {
+        job j = queue->pop();
+        std::string resp;
+        put_u32(resp, 0);
+        resp += run_job(*sim, term, j.request, default_steps);
+        unsigned int n = resp.size() - 4;
+        resp[0] = (char)(n >> 24);
+        resp[1] = (char)(n >> 16);
+        resp[2] = (char)(n >> 8);
+        resp[3] = (char)n;
+
+        //back to the main thread: the connection to read on, or ~fd to close it
+        int back = write_all(j.fd, resp.data(), resp.size()) ? j.fd : ~j.fd;
+        while(write(queue->done, &back, sizeof(back)) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+static void close_connection(std::map<int, connection>& conns, int fd)
+{
+    close(fd);
+    conns.erase(fd);
+}
+
+//queue the next request of the connection, unless one of it is already queued
+static void dispatch(job_queue* queue, std::map<int, connection>& conns, int fd)
+{
+    connection& c = conns[fd];
+    if(c.busy)
+        return;
+    job j;
+    bool whole;
+    if(!take_frame(c, j.request, whole))
+    {
+        close_connection(conns, fd);
+        return;
+    }
+    if(!whole)
+        return;
+    j.fd = fd;
+    c.busy = true;
+    queue->push(j);
+}
+
+int run_server(const std::string& path, int workers, long long max_steps)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "socket path too long: %s\n", path.c_str());
+        return Batch_Error;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    int sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sfd < 0)
+    {
+        perror("socket");
+        return Batch_Error;
+    }
+    unlink(path.c_str());
+    if(bind(sfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(sfd, 128) < 0)
+    {
+        perror(path.c_str());
+        close(sfd);
+        return Batch_Error;
+    }
+
+    int done[2];
+    if(pipe(done) < 0)
+    {
+        perror("pipe");
+        close(sfd);
+        return Batch_Error;
+    }
+    if(workers <= 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    job_queue* queue = new job_queue();         //outlives the detached workers
+    queue->done = done[1];
+    for(int i = 0; i < workers; i++)
+        std::thread(worker_main, queue, max_steps).detach();
+    fprintf(stderr, "serving on %s with %d workers\n", path.c_str(), workers);
+
+    //the main thread accepts and reads every connection; the workers only run requests
+    std::map<int, connection> conns;
+    std::vector<pollfd> fds;
+    while(true)
+    {
+        fds.clear();
+        pollfd listen_fd = {sfd, POLLIN, 0}, done_fd = {done[0], POLLIN, 0};
+        fds.push_back(listen_fd);
+        fds.push_back(done_fd);
+        for(std::map<int, connection>::iterator it = conns.begin(); it != conns.end(); ++it)
+            if(!it->second.busy)
+            {
+                pollfd p = {it->first, POLLIN, 0};
+                fds.push_back(p);
+            }
+        if(poll(&fds[0], fds.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        if(fds[1].revents & POLLIN)
+        {
+            int back[64];
+            ssize_t r = read(done[0], back, sizeof(back));
+            for(ssize_t i = 0; i < r / (ssize_t)sizeof(int); i++)
+            {
+                if(back[i] < 0)
+                {
+                    close_connection(conns, ~back[i]);
+                    continue;
+                }
+                conns[back[i]].busy = false;
+                dispatch(queue, conns, back[i]);
+            }
+        }
+        for(size_t i = 2; i < fds.size(); i++)
+        {
+            if(fds[i].revents == 0)
+                continue;
+            int fd = fds[i].fd;
+            char buf[65536];
+            ssize_t r = read(fd, buf, sizeof(buf));
+            if(r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+            if(r <= 0)
+            {
+                close_connection(conns, fd);
+                continue;
+            }
+            conns[fd].in.append(buf, r);
+            dispatch(queue, conns, fd);
+        }
+        if(fds[0].revents & POLLIN)
+        {
+            int fd = accept(sfd, NULL, NULL);
+            if(fd < 0)
+            {
+                if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+                    continue;
+                perror("accept");
+                break;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            conns[fd];
+        }
+    }
+    close(sfd);
+    return Batch_Error;
+}
+
+#else
+
+int run_server(const std::string& path, int workers, long long max_steps)
+{
+    fprintf(stderr, "--serve needs Unix domain sockets and is not available on Windows\n");
+    return Batch_Error;
+}
+
+#endif // _WIN32
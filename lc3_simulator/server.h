@@ -0,0 +1,30 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+#include <string>
+
+/*
+    Grading daemon: lc3_simulator --serve <socket> [--workers N] [--max-steps N]
+
+    Each worker thread owns a Simulator that is initialized once and put back to its
+    baseline with fast_reset() between jobs. Clients connect to the Unix domain socket
+    and send any number of requests, each answered by one response. The main thread reads
+    the connections and queues each whole request as a job for the next free worker, so
+    an idle connection holds no worker. The requests of one connection are run one at a
+    time and answered in order.
+
+    A request or response is a frame: a 32-bit big-endian payload length, then the payload.
+    The payload is a list of fields: a one-byte tag, a 32-bit big-endian length, the bytes.
+
+    request fields                          response fields
+      'B'  contents of a .bin file            'X'  batch_exit_code, decimal
+           (repeatable; PC starts at          'O'  display output
+           the first origin)                  'R'  registers, as printed by --dump-regs
+      'I'  keyboard input                     'N'  instructions executed, decimal
+      'S'  step budget, decimal               'E'  error message, when 'X' is Batch_Error
+      'P'  start address, e.g. x3000
+*/
+
+int run_server(const std::string& path, int workers, long long max_steps);  //serve until killed; returns an exit code on failure
+
+#endif // SERVER_H_INCLUDED
@@ -1,236 +1,386 @@
-#ifndef SIM_H_INCLUDED
-#define SIM_H_INCLUDED
-
-#include <conio.h>
-#include <windows.h>
-#include <string>
-#include <map>
-#include <set>
-#include <vector>
-#include <sstream>
-
-typedef unsigned short int word;
-
-class Simulator
-{
-public:
-    enum status_code
-    {
-        Breakpoint,
-        Normal,
-        Priviledge_Exception,
-        User_Interrupt,
-        Exit,
-        Select
-    };
-
-    const int DSR_ = 0xfe04;
-    const int DDR_ = 0xfe06;
-    const int KBSR_ = 0xfe00;
-    const int KBDR_ = 0xfe02;
-
-    std::map<std::string, word> asm_map;
-
-    word gen_reg[8];                //general purpose register R0-R7
-    word PC, MAR, MDR, IR, PSR, Saved_USP, Saved_SSP;          //
-
-    HANDLE stdOutputHandle;
-    status_code sim_status;
-
-    int vstart;
-    bool vtrackPC;
-    int vselect;
-    word vjump;
-    int HistoryCount;
-
-
-
-    std::stringstream message;
-    word mem[0x10000];                  //memory x0000-xFFFF. x0000-xFDFF for memory locations, xFE00-xFFFF for device registers.
-    bool breakpoints[0x10000];          //is breakpoint
-    std::set<word> breakpoints_set;     //set of breakpoints;
-
-    void cursor_xy(int x, int y);
-    void text_color(unsigned short int color);
-
-    void initialize();                          //initialize the simulator.
-
-    bool isNOP(word h);                         //check if a 16-bit data is an operation
-
-    bool check_interrupt();                     //check and process an interrupt.
-    void process_interrupt(word INTV, word Priority);   //process an interrupt
-    void process_instr(word instr);             //process an instruction.
-    void device_keyboard();
-    void device_monitor();
-
-    void load_os();                             //load the operating system code.
-    void load_bin(std::string filename);        //load an .bin file
-    void load_obj(std::string filename);        //load an .obj file
-    void save_mem(std::string filename, word _start, word _end);
-
-    word slice(word x, short int a, short int b){return ((x%(1<<b))>>a);}
-    word sign_extend(word x, int n){return bit(x, n-1)?(((0xffff>>n)<<n) + x):x;}
-    word bin_to_word(char str[]);
-    word to_word(std::string str);                          // transform number string e.g.  "#102", "x8000"
-    std::string word_to_bin(word x);
-    std::vector<std::string> instr_to_asm(word h);          //return the asm string of an instruction
-    std::string str_reg(word x, int _start, int _end);
-    std::string str_imm(word x, int _start, int _end);      //decimal
-    std::string str_imm(word x);
-    std::string str_fulhex(word);                           //hex
-    bool bit(word x, int i){return (x&(1<<i)) != 0;}
-    void setcc(word x)
-    {
-        PSR = PSR&0xfff8;
-        if(bit(x, 15))
-            PSR += 4;
-        else if(x == 0)
-            PSR += 2;
-        else
-            PSR += 1;
-    }
-
-    void assembler(std::string filename, std::string ofilename);
-    void add_overflow_err(int line, int bitn);
-    std::vector<std::string> split(std::string str);
-    std::string split_first(std::string& str);
-    bool check_number(word x, int n);
-    word to_reg(std::string s);
-    std::string trim_space(std::string s);
-
-    /////////                           the LC-3 instructions               //////////
-    void ADD(int DR, int SR1, int SR2)
-    {
-        setcc(gen_reg[DR] = gen_reg[SR1] + gen_reg[SR2]);
-    }
-    void ADDimm(int DR, int SR1, word imm5)
-    {
-        setcc(gen_reg[DR] = gen_reg[SR1] + sign_extend(imm5, 5));
-    }
-    void AND(int DR, int SR1, int SR2)
-    {
-        setcc(gen_reg[DR] = gen_reg[SR1] & gen_reg[SR2]);
-    }
-    void ANDimm(int DR, int SR1, word imm5)
-    {
-        setcc(gen_reg[DR] = gen_reg[SR1] & sign_extend(imm5, 5));
-    }
-    void NOT(int DR, int SR)
-    {
-        setcc(gen_reg[DR] = ~(gen_reg[SR]));
-    }
-    void BR(word nzp, word PCoffset9)
-    {
-        if(nzp&PSR)
-            PC += sign_extend(PCoffset9, 9);
-    }
-    void JMP(int BaseR)
-    {
-        PC = gen_reg[BaseR];
-    }
-    void JSR(word PCoffset11)
-    {
-        gen_reg[7] = PC;
-        PC += sign_extend(PCoffset11, 11);
-    }
-    void JSRR(int BaseR)
-    {
-        gen_reg[7] = PC;
-        PC = gen_reg[BaseR];
-    }
-    void LD(int DR, word PCoffset9)
-    {
-        word tar = PC + sign_extend(PCoffset9, 9);
-        if(tar == KBDR_)
-            mem[KBSR_] = mem[KBSR_] & 0x7fff;
-        setcc(gen_reg[DR] = mem[tar]);
-    }
-    void LDI(int DR, word PCoffset9)
-    {
-        word tar = mem[PC + sign_extend(PCoffset9, 9)];
-        if(tar == KBDR_)
-            mem[KBSR_] = mem[KBSR_] & 0x7fff;
-        setcc(gen_reg[DR] = mem[tar]);
-    }
-    void LDR(int DR, int BaseR, word offset6)
-    {
-        word tar =  gen_reg[BaseR] + sign_extend(offset6, 6);
-        if(tar == KBDR_)
-            mem[KBSR_] = mem[KBSR_] & 0x7fff;
-        setcc(gen_reg[DR] = mem[tar]);
-    }
-    void LEA(int DR, word PCoffset9)
-    {
-        setcc(gen_reg[DR] = PC + sign_extend(PCoffset9, 9));
-    }
-    void RET()
-    {
-        PC = gen_reg[7];
-    }
-    void RTI()
-    {
-        if(!bit(PSR, 15))
-        {
-            PC = mem[gen_reg[6]];
-            gen_reg[6]++;
-            PSR = mem[gen_reg[6]];
-            gen_reg[6]++;
-            if(bit(PSR, 15))
-            {
-                Saved_SSP  = gen_reg[6];
-                gen_reg[6] = Saved_USP;
-            }
-        }
-        else
-            sim_status = Priviledge_Exception;
-    }
-    void ST(int SR, word PCoffset9)
-    {
-        word tar = PC + sign_extend(PCoffset9, 9);
-        if(tar == DDR_)
-            mem[DSR_] = mem[DSR_] & 0x7fff;
-        mem[tar] = gen_reg[SR];
-    }
-    void STI(int SR, word PCoffset9)
-    {
-        word tar = mem[PC + sign_extend(PCoffset9, 9)];
-        if(tar == DDR_)
-            mem[DSR_] = mem[DSR_] & 0x7fff;
-        mem[tar] = gen_reg[SR];
-    }
-    void STR(int SR, int BaseR, word offset6)
-    {
-        word tar = gen_reg[BaseR] + sign_extend(offset6, 6);
-        if(tar == DDR_)
-            mem[DSR_] = mem[DSR_] & 0x7fff;
-        mem[gen_reg[BaseR] + sign_extend(offset6, 6)] = gen_reg[SR];
-    }
-    void TRAP(word trapvect8)
-    {
-        gen_reg[7] = PC;
-        PC = mem[trapvect8];
-    }
-    ///////////////////////////////////////////////////////////////////////////////////
-
-
-    /////////                           Commands                           ////////////
-    void step_over();                   //
-    void run();                         //run the simulator till breakpoint or interrupted by the user
-    void run(int i);                    //run i steps or till breakpoint or interrupted by the user
-    void set_bk(word loc);              //set breakpoint
-    void cancel_bk(word loc);           //cancel breakpoint
-    void cancel_all_bk();               //cancel all breakpoints
-    void clear_count();                 //clear the count of instructions executed
-    void set_value(std::string t, std::string v);   //set the value of t
-    bool cmd(char str[]);               //execute a command
-    void show_mem(int _start, int _end);        //show part of mem
-    void show_mem();        //show part of mem
-    void show_message();
-    void show_status();
-    /////////                           simulator info                      ///////////
-
-private:
-
-};
-
-#endif // SIM_H_INCLUDED
+#ifndef SIM_H_INCLUDED
+#define SIM_H_INCLUDED
+
+#include "terminal.h"
+#include "device.h"
+#include "metrics.h"
+#include "probe.h"
+#include <string>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <bitset>
+#include <queue>
+
+typedef unsigned short int word;
+
+struct debug_map;
+
+class Simulator
+{
+public:
+    enum status_code
+    {
+        Breakpoint,
+        Normal,
+        Priviledge_Exception,
+        User_Interrupt,
+        Exit,
+        Select,
+        Halt,
+        Reconfigure         //internal to run(): an event was scheduled under a run loop without events
+    };
+    //features compiled into an instantiation of the run loop; run() picks the fewest the configuration needs
+    enum run_feature
+    {
+        Run_Probes = 1,             //call the attached probes
+        Run_Breakpoints = 2,        //stop at the breakpoints
+        Run_Trace = 4,              //record the address of every instruction in trace
+        Run_Profile = 8,            //count the executions of every address in profile
+        Run_Events = 16,            //run the device events that are due and take interrupts
+        Run_Shared = 32,            //fetch x0000-xFDFF from shared_mem
+        Run_All = 63
+    };
+
+    static const int DSR_ = 0xfe04;
+    static const int DDR_ = 0xfe06;
+    static const int KBSR_ = 0xfe00;
+    static const int KBDR_ = 0xfe02;
+    static const int TMSR_ = 0xfe08;    //interval timer status: [15] expired, [14] interrupt enable, [10:8] priority, [1] periodic, [0] running
+    static const int TMIR_ = 0xfe0a;    //interval timer period, in instructions
+    static const int ICPR_ = 0xfe10;    //interrupt controller: bit i is set while line i requests, read only
+    static const int ICMR_ = 0xfe12;    //interrupt controller: bit i enables line i, all set by initialize()
+
+    //interrupt request line of a device
+    struct irq_line
+    {
+        const char* name;
+        word vector;
+        word priority;                  //PL0-PL7; a PL0 request never interrupts
+        unsigned long long asserted_at; //cycle the request was raised
+        unsigned long long taken, latency_sum, latency_max;     //interrupts taken, cycles from request to handler entry
+    };
+
+    static const int max_irq = 16;
+
+    //something a device will do at a future cycle
+    struct sim_event
+    {
+        unsigned long long time;
+        Device* dev;                    //NULL: re-evaluate the interrupt requests
+        word tag;                       //passed back to Device::event()
+        bool operator>(const sim_event& e) const {return time > e.time;}
+    };
+
+    //hot CPU state, packed into the first cache line of the object
+    alignas(64) word gen_reg[8];        //general purpose register R0-R7
+    word PC, MAR, MDR, IR, PSR, Saved_USP, Saved_SSP;          //
+    word io_base;                       //loads and stores at or above it go through the device table
+    status_code sim_status;
+    unsigned long long HistoryCount;    //instructions retired since initialize()
+    std::unique_ptr<std::bitset<0x10000> > breakpoints;        //allocated by the first set_bk()
+    unsigned long long cycle;           //steps since initialize(), the clock of the device events
+    unsigned long long next_event;      //cycle of the earliest pending event
+
+    alignas(64) word mem[0x10000];      //memory x0000-xFFFF. x0000-xFDFF for memory locations, xFE00-xFFFF for device registers.
+
+    sim_metrics metrics;                //counters kept by the core, exported through MetricsRegistry
+    std::bitset<0x100> dirty_pages;     //256-word pages written since the baseline was saved
+    std::shared_ptr<const std::vector<word> > baseline_mem;    //memory image of the baseline, shared by the simulators whose baselines are the same
+    word baseline_reg[8];               //CPU state of the baseline
+    word baseline_PC, baseline_PSR, baseline_USP, baseline_SSP;
+
+    Terminal* term = NULL;              //keyboard and display of the LC-3; no I/O if NULL
+    std::vector<std::unique_ptr<Device> > devices;     //registered by add_device()
+    unsigned char io_map[0x200];        //device of each address xFE00-xFFFF, as its index in devices plus one; 0 for plain memory
+    unsigned char io_pages[0xfe];       //the same for each 256-word page below xFE00, e.g. video memory
+    word device_base;                   //lowest address claimed by a device; io_base unless probes are attached
+    KeyboardDevice* keyboard;           //KBSR/KBDR, owned by devices
+    std::vector<Probe*> probes;         //attached by add_probe(), not owned
+    word* shared_mem = NULL;            //memory of the boot CPU, for a CPU of an SmpSystem other than it (see smp.h)
+    bool extensions = false;            //execute 1101 as the extension ops (see EXT()); a reserved no-op otherwise
+    int run_features = Run_All;         //of the running loop; Run_All when not running
+    //the trace ring and the execution profile; allocated while either is on
+    struct run_history
+    {
+        std::vector<word> trace;        //ring of the addresses of the last instructions; a power of two, empty when off
+        unsigned int trace_pos = 0;     //total recorded; the next goes at trace_pos % trace.size()
+        std::vector<unsigned long long> profile;        //executions of each address; empty when off
+    };
+    std::unique_ptr<run_history> history;
+    std::priority_queue<sim_event, std::vector<sim_event>, std::greater<sim_event> > events;
+    irq_line irq[max_irq];
+    int irq_count = 0;
+    word irq_raised;                    //bit i: line i requests
+    word irq_levels;                    //bit p: an enabled line requests at priority p
+
+    std::string os_file;                //OS image loaded instead of the embedded one, if not empty
+    std::unique_ptr<std::stringstream> messages;        //see message()
+
+    void initialize();                          //initialize the simulator.
+    void save_baseline();                       //record the current state as the baseline of fast_reset()
+    void fast_reset();                          //restore the baseline, copying back only the dirty pages
+    void mark_dirty(word loc){dirty_pages.set(loc>>8);}
+    std::stringstream& message()                //messages of the console and of the loaders; allocated when first used
+    {
+        if(!messages)
+            messages.reset(new std::stringstream());
+        return *messages;
+    }
+
+    bool isNOP(word h);                         //check if a 16-bit data is an operation
+
+    bool check_interrupt();                     //take the most urgent interrupt request above the current priority
+    int add_irq(const char* name, word vector, word priority);     //a new interrupt request line; returns its number
+    void set_irq(int line, bool level);         //raise or drop an interrupt request
+    void set_irq_priority(int line, word priority);
+    void update_irq_levels();
+    std::string irq_report();                   //interrupts taken and their latency, by line
+    void process_interrupt(word INTV, word Priority);   //process an interrupt
+    void process_instr(word instr);             //process an instruction.
+    void add_probe(Probe* p);                   //instrument the run from now on; every load and store becomes an I/O access
+    void remove_probe(Probe* p);
+    void add_device(Device* dev, word first, word last);   //take ownership of dev and map it to the addresses first-last; whole pages below xFE00; at most 255 devices
+    void schedule(Device* dev, unsigned long long delay, word tag = 0);    //post an event delay cycles from now
+    void reset_devices();                       //drop all events, restart the device clock at cycle 0 and let the devices resample their state
+    bool process_events();                      //run the events that are due; true if an interrupt was taken
+    word load_io(word tar);                     //a load at or above io_base
+    void store_io(word tar, word v);            //a store at or above io_base
+    word load(word tar)
+    {
+        metrics.reads[tar>>12]++;
+        return tar >= io_base ? load_io(tar) : mem[tar];
+    }
+    void store(word tar, word v)
+    {
+        metrics.writes[tar>>12]++;
+        dma_store(tar, v);
+    }
+    void dma_store(word tar, word v)            //a store not made by the program, e.g. a DMA transfer or the console's set; not counted as its
+    {
+        if(tar >= io_base)
+            store_io(tar, v);
+        else
+        {
+            mem[tar] = v;
+            mark_dirty(tar);
+        }
+    }
+
+    void load_os();                             //load the operating system code.
+    bool load_os(std::string filename);         //load the operating system code from a file from now on; false if it cannot be loaded
+    bool load_bin(std::string filename);        //load an .bin file
+    bool load_bin_text(const std::string& text);        //load the contents of an .bin file
+    bool load_words(const std::vector<word>& data);     //load an image: its origin followed by its words
+    word load_origin;                           //origin of the last image loaded
+    void load_obj(std::string filename);        //load an .obj file
+    void save_mem(std::string filename, word _start, word _end);
+
+    static word slice(word x, short int a, short int b){return ((x%(1<<b))>>a);}
+    static word sign_extend(word x, int n){return bit(x, n-1)?(((0xffff>>n)<<n) + x):x;}
+    static word bin_to_word(char str[]);
+    static word to_word(std::string str);                   // transform number string e.g.  "#102", "x8000"
+    static std::string word_to_bin(word x);
+    std::vector<std::string> instr_to_asm(word h);          //return the asm string of an instruction
+    static bool pc_target(word addr, word h, word& target); //the PC-relative address of BR/JSR/LD/ST/LDI/STI/LEA at addr
+    static std::string str_reg(word x, int _start, int _end);
+    static std::string str_imm(word x, int _start, int _end);      //decimal
+    static std::string str_imm(word x);
+    static std::string str_fulhex(word);                    //hex
+    static std::string trim_space(std::string s);
+    static bool bit(word x, int i){return (x&(1<<i)) != 0;}
+    void setcc(word x)
+    {
+        PSR = PSR&0xfff8;
+        if(bit(x, 15))
+            PSR += 4;
+        else if(x == 0)
+            PSR += 2;
+        else
+            PSR += 1;
+    }
+
+    void assembler(std::string filename, std::string ofilename);    //see assembler.h
+    bool assemble(std::string filename, std::vector<word>& bin, debug_map* map = NULL);   //with the debug map of the image if map is given
+
+    /////////                           the LC-3 instructions               //////////
+    void ADD(int DR, int SR1, int SR2)
+    {
+        setcc(gen_reg[DR] = gen_reg[SR1] + gen_reg[SR2]);
+    }
+    void ADDimm(int DR, int SR1, word imm5)
+    {
+        setcc(gen_reg[DR] = gen_reg[SR1] + sign_extend(imm5, 5));
+    }
+    void AND(int DR, int SR1, int SR2)
+    {
+        setcc(gen_reg[DR] = gen_reg[SR1] & gen_reg[SR2]);
+    }
+    void ANDimm(int DR, int SR1, word imm5)
+    {
+        setcc(gen_reg[DR] = gen_reg[SR1] & sign_extend(imm5, 5));
+    }
+    void NOT(int DR, int SR)
+    {
+        setcc(gen_reg[DR] = ~(gen_reg[SR]));
+    }
+    void BR(word nzp, word PCoffset9)
+    {
+        if(nzp&PSR)
+        {
+            PC += sign_extend(PCoffset9, 9);
+            metrics.branches_taken++;
+        }
+    }
+    void JMP(int BaseR)
+    {
+        PC = gen_reg[BaseR];
+    }
+    void JSR(word PCoffset11)
+    {
+        gen_reg[7] = PC;
+        PC += sign_extend(PCoffset11, 11);
+    }
+    void JSRR(int BaseR)
+    {
+        gen_reg[7] = PC;
+        PC = gen_reg[BaseR];
+    }
+    void LD(int DR, word PCoffset9)
+    {
+        word tar = PC + sign_extend(PCoffset9, 9);
+        setcc(gen_reg[DR] = load(tar));
+    }
+    void LDI(int DR, word PCoffset9)
+    {
+        word tar = load(PC + sign_extend(PCoffset9, 9));
+        setcc(gen_reg[DR] = load(tar));
+    }
+    void LDR(int DR, int BaseR, word offset6)
+    {
+        word tar = gen_reg[BaseR] + sign_extend(offset6, 6);
+        setcc(gen_reg[DR] = load(tar));
+    }
+    void LEA(int DR, word PCoffset9)
+    {
+        setcc(gen_reg[DR] = PC + sign_extend(PCoffset9, 9));
+    }
+    void RET()
+    {
+        PC = gen_reg[7];
+    }
+    void RTI()
+    {
+        if(!bit(PSR, 15))
+        {
+            PC = load(gen_reg[6]);
+            gen_reg[6]++;
+            PSR = load(gen_reg[6]);
+            gen_reg[6]++;
+            if(bit(PSR, 15))
+            {
+                Saved_SSP  = gen_reg[6];
+                gen_reg[6] = Saved_USP;
+            }
+            schedule(NULL, 0);                  //a request masked by the old priority may be taken now
+        }
+        else
+            sim_status = Priviledge_Exception;
+    }
+    void ST(int SR, word PCoffset9)
+    {
+        word tar = PC + sign_extend(PCoffset9, 9);
+        store(tar, gen_reg[SR]);
+    }
+    void STI(int SR, word PCoffset9)
+    {
+        word tar = load(PC + sign_extend(PCoffset9, 9));
+        store(tar, gen_reg[SR]);
+    }
+    void STR(int SR, int BaseR, word offset6)
+    {
+        word tar = gen_reg[BaseR] + sign_extend(offset6, 6);
+        store(tar, gen_reg[SR]);
+    }
+    /*
+        1101 DR SR1 op SR2, executed only when extensions is set. The arithmetic sets the
+        condition codes; the block ops change no register and no condition code.
+        op 0 MUL  DR = SR1 * SR2, low 16 bits
+        op 1 DIV  DR = SR1 / SR2, signed, toward zero; xFFFF if SR2 is 0
+        op 2 MOD  DR = SR1 % SR2, with the sign of SR1; SR1 if SR2 is 0
+        op 3 SHL  DR = SR1 << (SR2 & 15)
+        op 4 SHR  DR = SR1 >> (SR2 & 15), logical
+        op 5 SRA  DR = SR1 >> (SR2 & 15), arithmetic
+        op 6 MCPY copy SR2 words from address SR1 to address DR, as memmove does
+        op 7 MFIL store SR1 in SR2 words from address DR
+    */
+    void EXT(int DR, int SR1, int op, int SR2)
+    {
+        word a = gen_reg[SR1], b = gen_reg[SR2];
+        switch(op)
+        {
+        case 0:
+            setcc(gen_reg[DR] = a * b);
+            break;
+        case 1:
+            setcc(gen_reg[DR] = b == 0 ? 0xffff : (short)a / (short)b);
+            break;
+        case 2:
+            setcc(gen_reg[DR] = b == 0 ? a : (short)a % (short)b);
+            break;
+        case 3:
+            setcc(gen_reg[DR] = a << (b & 15));
+            break;
+        case 4:
+            setcc(gen_reg[DR] = a >> (b & 15));
+            break;
+        case 5:
+            setcc(gen_reg[DR] = (short)a >> (b & 15));
+            break;
+        case 6:
+            MCPY(gen_reg[DR], a, b);
+            break;
+        case 7:
+            MFIL(gen_reg[DR], a, b);
+            break;
+        }
+    }
+    void MCPY(word dst, word src, word n);
+    void MFIL(word dst, word v, word n);
+    void TRAP(word trapvect8)
+    {
+        metrics.traps[trapvect8]++;
+        gen_reg[7] = PC;
+        if(trapvect8 == 0x25)           //HALT stops the clock here; the OS has no HALT routine
+            sim_status = Halt;
+        else
+            PC = load(trapvect8);
+    }
+    ///////////////////////////////////////////////////////////////////////////////////
+
+
+    /////////                           Commands                           ////////////
+    template<int Features> void step(); //one instruction or interrupt entry, with these run_features
+    template<int Features> void run_loop(long long& i);        //step till i is 0 or the status is not Normal
+    int features();                     //the run_features the configuration needs now
+    void step_over();                   //
+    void run();                         //run the simulator till breakpoint or interrupted by the user
+    void run(long long i);              //run i steps or till breakpoint or interrupted by the user
+    bool is_bk(word loc){return breakpoints && (*breakpoints)[loc];}
+    void set_bk(word loc);              //set breakpoint
+    void cancel_bk(word loc);           //cancel breakpoint
+    void cancel_all_bk();               //cancel all breakpoints
+    void set_trace(int size);           //record the last size instructions (rounded up to a power of two); 0 for off
+    void set_profile(bool on);          //count the executions of each address from now on, or stop
+    std::string trace_report(int n);    //the last n instructions recorded, oldest first
+    std::string profile_report(int n);  //the n addresses executed most
+    void clear_count();                 //clear the count of instructions executed
+    void set_value(std::string t, std::string v);   //set the value of t
+    bool cmd(char str[]);               //execute a command
+    /////////                           simulator info                      ///////////
+
+private:
+
+};
+
+#endif // SIM_H_INCLUDED
@@ -0,0 +1,208 @@
+#include "smp.h"
+#include "sim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//compare-and-swap and exchange on a word of the shared memory, ordered with those of the other CPUs
+static word atomic_cas(word* p, word expected, word v)
+{
+#if defined(__GNUC__)
+    __atomic_compare_exchange_n(p, &expected, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+#else
+    return _InterlockedCompareExchange16((short*)p, v, expected);
+#endif
+}
+
+static word atomic_exchange(word* p, word v)
+{
+#if defined(__GNUC__)
+    return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+#else
+    return _InterlockedExchange16((short*)p, v);
+#endif
+}
+
+SmpDevice::SmpDevice(Simulator& sim, SmpSystem& _system, word _id) : system(_system), id(_id)
+{
+    line = sim.add_irq("ipi", 0x04, 2);
+}
+
+word SmpDevice::read(Simulator& sim, word addr)
+{
+    switch(addr)
+    {
+    case CPUID:
+        return id;
+    case CPUN:
+        return system.cpus.size();
+    case IPSR:
+        return pending ? 0x8000 : 0;
+    case ATAR:
+        return atar;
+    case ATCV:
+        return atcv;
+    case ATSW:
+        return old;
+    case ATTS:
+        old = atar < 0xfe00 ? atomic_exchange(shared + atar, 1) : 0;
+        return old;
+    default:
+        return sim.mem[addr];
+    }
+}
+
+void SmpDevice::write(Simulator& sim, word addr, word v)
+{
+    switch(addr)
+    {
+    case IPIR:
+        system.send_ipi(v);
+        break;
+    case IPSR:
+        pending = false;
+        sim.set_irq(line, false);
+        break;
+    case ATAR:
+        atar = v;
+        break;
+    case ATCV:
+        atcv = v;
+        break;
+    case ATSW:
+        old = atar < 0xfe00 ? atomic_cas(shared + atar, atcv, v) : 0;
+        break;
+    default:
+        break;                          //CPUID, CPUN and ATTS are read only
+    }
+}
+
+void SmpDevice::event(Simulator& sim, word tag)
+{
+    sim.schedule(this, poll_interval);
+    if(ipi.exchange(false))
+    {
+        pending = true;
+        ipis++;
+        sim.set_irq(line, true);
+    }
+}
+
+void SmpDevice::reset(Simulator& sim)
+{
+    pending = false;
+    sim.schedule(this, poll_interval);
+}
+
+SmpSystem::SmpSystem(Simulator& boot, int n)
+{
+    cpus.push_back(&boot);
+    for(int i = 1; i < n; i++)
+    {
+        Simulator* cpu = new Simulator();
+        secondaries.push_back(std::unique_ptr<Simulator>(cpu));
+        cpu->initialize();
+        cpu->extensions = boot.extensions;
+        cpu->shared_mem = boot.mem;
+        cpu->add_device(new SharedMemoryDevice(boot.mem), 0, 0xfdff);
+        cpus.push_back(cpu);
+    }
+    for(int i = 0; i < n; i++)
+    {
+        SmpDevice* unit = new SmpDevice(*cpus[i], *this, i);
+        unit->shared = boot.mem;
+        cpus[i]->add_device(unit, SmpDevice::CPUID, SmpDevice::ATTS + 1);
+        unit->reset(*cpus[i]);
+        units.push_back(unit);
+    }
+}
+
+SmpSystem::~SmpSystem()
+{
+}
+
+void SmpSystem::start(word pc)
+{
+    Simulator& boot = *cpus[0];
+    boot.PC = pc;
+    for(size_t i = 1; i < cpus.size(); i++)
+    {
+        Simulator& cpu = *cpus[i];
+        memcpy(cpu.gen_reg, boot.gen_reg, sizeof(cpu.gen_reg));
+        cpu.PC = pc;
+        cpu.PSR = boot.PSR;
+        cpu.Saved_USP = boot.Saved_USP;
+        cpu.Saved_SSP = boot.Saved_SSP - i * 0x100;
+    }
+}
+
+void SmpSystem::send_ipi(word mask)
+{
+    for(size_t i = 0; i < units.size(); i++)
+        if(Simulator::bit(mask, i))
+            units[i]->ipi = true;
+}
+
+void SmpSystem::mark_shared_dirty()
+{
+    //the other CPUs store through SharedMemoryDevice, and on their own threads, so the pages are not tracked one by one
+    for(int p = 0; p < 0xfe; p++)
+        cpus[0]->dirty_pages.set(p);
+}
+
+void SmpSystem::run(long long max_steps)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < cpus.size(); i++)
+        threads.push_back(std::thread([this, i, max_steps]{cpus[i]->run(max_steps);}));
+    cpus[0]->run(max_steps);
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    mark_shared_dirty();
+    run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SmpSystem::run_round_robin(long long max_steps, int quantum)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<long long> left(cpus.size(), max_steps);
+    std::vector<bool> running(cpus.size(), true);
+    for(size_t live = cpus.size(); live > 0; )
+    {
+        live = 0;
+        for(size_t i = 0; i < cpus.size(); i++)
+        {
+            if(!running[i])
+                continue;
+            Simulator& cpu = *cpus[i];
+            unsigned long long steps = cpu.cycle;
+            cpu.run(std::min<long long>(quantum, left[i]));
+            left[i] -= cpu.cycle - steps;
+            running[i] = cpu.sim_status == Simulator::Normal && left[i] > 0;
+            live += running[i];
+        }
+    }
+    mark_shared_dirty();
+    run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string SmpSystem::report()
+{
+    std::stringstream strm;
+    unsigned long long total = 0;
+    for(size_t i = 0; i < cpus.size(); i++)
+    {
+        strm << "cpu " << i << ": instructions " << cpus[i]->HistoryCount << " IPIs " << units[i]->ipis
+             << " status " << cpus[i]->sim_status << " PC " << Simulator::str_fulhex(cpus[i]->PC) << std::endl;
+        total += cpus[i]->HistoryCount;
+    }
+    strm << "total: instructions " << total << " in " << run_ms << " ms, " << (run_ms > 0 ? total / (run_ms * 1000) : 0) << " MIPS" << std::endl;
+    return strm.str();
+}
@@ -0,0 +1,107 @@
+#ifndef SMP_H_INCLUDED
+#define SMP_H_INCLUDED
+
+#include "device.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Simulator;
+class SmpSystem;
+
+/*
+    The SMP unit of one CPU. Its registers are private to the CPU, like the rest of the
+    device page xFE00-xFFFF.
+
+    CPUID xFE30  number of this CPU, 0 for the boot CPU; read only
+    CPUN  xFE32  number of CPUs; read only
+    IPIR  xFE34  a write sends an inter-processor interrupt to each CPU whose bit is set
+    IPSR  xFE36  [15] an IPI is pending; any write acknowledges it
+    ATAR  xFE38  address of the atomic operations, below xFE00
+    ATCV  xFE3A  value compared by ATSW
+    ATSW  xFE3C  a write v is a compare-and-swap: if mem[ATAR] == ATCV it becomes v.
+                 A read gives the value mem[ATAR] had before the last ATSW or ATTS
+    ATTS  xFE3E  a read is a test-and-set: mem[ATAR] becomes 1 and the read gives its old value
+
+    The IPI is interrupt vector x04 at PL2, masked by ICMR like the other lines. A CPU
+    notices IPIs sent to it every poll_interval of its instructions.
+*/
+class SmpDevice : public Device
+{
+public:
+    static const int CPUID = 0xfe30;
+    static const int CPUN = 0xfe32;
+    static const int IPIR = 0xfe34;
+    static const int IPSR = 0xfe36;
+    static const int ATAR = 0xfe38;
+    static const int ATCV = 0xfe3a;
+    static const int ATSW = 0xfe3c;
+    static const int ATTS = 0xfe3e;
+    static const int poll_interval = 16;
+
+    SmpSystem& system;
+    word* shared;                       //the shared memory
+    word id;
+    int line;
+    std::atomic<bool> ipi{false};       //set by the sender's thread, taken by this CPU at its next poll
+    bool pending = false;               //IPSR[15]
+    word atar = 0, atcv = 0, old = 0;
+    unsigned long long ipis = 0;        //IPIs taken
+
+    SmpDevice(Simulator& sim, SmpSystem& _system, word _id);
+    word read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr, word v);
+    void event(Simulator& sim, word tag);   //poll for IPIs
+    void reset(Simulator& sim);
+    const char* name(){return "smp";}
+};
+
+//the shared memory x0000-xFDFF as seen by the loads and stores of a CPU other than the boot CPU
+class SharedMemoryDevice : public Device
+{
+public:
+    word* shared;
+
+    SharedMemoryDevice(word* _shared) : shared(_shared) {}
+    word read(Simulator& sim, word addr){return shared[addr];}
+    void write(Simulator& sim, word addr, word v){shared[addr] = v;}
+    const char* name(){return "shared memory";}
+};
+
+/*
+    N LC-3 CPUs on one memory. The boot CPU is the Simulator the program was loaded into:
+    its memory x0000-xFDFF is the shared memory and it keeps the terminal, the disk and the
+    video memory. Every other CPU is a Simulator of its own with private registers, device
+    page, timer and interrupt controller, and no terminal. All the CPUs start at the same
+    address and tell themselves apart by CPUID; CPU i starts with its supervisor stack
+    i x100 words below that of the boot CPU.
+
+    run() gives every CPU a host thread; plain loads and stores of different CPUs are
+    not ordered, while ATSW and ATTS are atomic and ordered. run_round_robin() runs the CPUs
+    in turn on the calling thread, quantum instructions each, and is reproducible. After a
+    run every page of the shared memory is dirty to the boot CPU, so its fast_reset()
+    restores all of them.
+*/
+class SmpSystem
+{
+public:
+    std::vector<Simulator*> cpus;       //cpus[0] is the boot CPU
+    std::vector<SmpDevice*> units;      //the SMP unit of each CPU, owned by its Simulator
+    double run_ms = 0;                  //wall-clock time of the last run
+
+    SmpSystem(Simulator& boot, int n);
+    ~SmpSystem();
+    void start(word pc);
+    void run(long long max_steps);                              //till every CPU stops, at most max_steps instructions each
+    void run_round_robin(long long max_steps, int quantum);
+    void send_ipi(word mask);
+    std::string report();               //instructions, IPIs and status of each CPU and the total MIPS
+
+private:
+    std::vector<std::unique_ptr<Simulator> > secondaries;
+
+    void mark_shared_dirty();           //for fast_reset() of the boot CPU, which does not see the stores of the others
+};
+
+#endif // SMP_H_INCLUDED
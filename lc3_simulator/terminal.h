@@ -0,0 +1,59 @@
+#ifndef TERMINAL_H_INCLUDED
+#define TERMINAL_H_INCLUDED
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+//the keyboard and screen the simulator talks to.
+class Terminal
+{
+public:
+    bool interactive;                   //keys are typed by a user: ESC interrupts the program
+
+    Terminal(): interactive(true) {}
+    virtual ~Terminal() {}
+
+    virtual bool kbhit() = 0;                           //is there a key to read
+    virtual int getch() = 0;                            //read a key without echo
+    virtual void put_char(char c) = 0;                  //print a character of the LC-3 display
+    virtual bool getline(char str[], int n) = 0;        //read a command line
+
+    virtual void cursor_xy(int x, int y) {}
+    virtual void text_color(unsigned short int color) {}    //console attribute: low 4 bits foreground, high 4 bits background
+    virtual void clear_screen() {}
+    virtual void pause() {}
+};
+
+//a terminal without a console: keys come from a string and the display is captured into a string.
+class BufferTerminal : public Terminal
+{
+public:
+    std::string input;
+    size_t input_pos;
+    std::string output;
+
+    BufferTerminal(): input_pos(0) {interactive = false;}
+    BufferTerminal(const std::string& in): input(in), input_pos(0) {interactive = false;}
+
+    bool kbhit() {return input_pos < input.size();}
+    int getch() {return input_pos < input.size() ? (unsigned char)input[input_pos++] : -1;}
+    void put_char(char c) {output += c;}
+    bool getline(char str[], int n)
+    {
+        if(input_pos >= input.size() || n <= 0)
+            return false;
+        size_t end = input.find('\n', input_pos);
+        if(end == std::string::npos)
+            end = input.size();
+        size_t len = std::min(end - input_pos, (size_t)n - 1);
+        memcpy(str, input.data() + input_pos, len);
+        str[len] = '\0';
+        input_pos = end < input.size() ? end + 1 : end;
+        return true;
+    }
+};
+
+Terminal* create_console_terminal();    //the console of the platform; defined by the front end
+
+#endif // TERMINAL_H_INCLUDED
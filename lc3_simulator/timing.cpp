@@ -0,0 +1,272 @@
+#include "timing.h"
+#include "sim.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+static const int CC = 8;        //the condition codes, as a ninth register
+
+BranchPredictor* BranchPredictor::create(const std::string& spec)
+{
+    std::string kind = spec.substr(0, spec.find(':'));
+    int bits = spec.find(':') == std::string::npos ? 10 : atoi(spec.substr(spec.find(':') + 1).c_str());
+    if(bits < 1 || bits > 16)
+        return NULL;
+    if(kind == "nt")
+        return new StaticPredictor(StaticPredictor::Not_Taken);
+    if(kind == "t")
+        return new StaticPredictor(StaticPredictor::Taken);
+    if(kind == "btfn")
+        return new StaticPredictor(StaticPredictor::Backward_Taken);
+    if(kind == "2bit")
+        return new BimodalPredictor(bits);
+    if(kind == "gshare")
+        return new GsharePredictor(bits);
+    return NULL;
+}
+
+bool StaticPredictor::predict(word pc, word target)
+{
+    if(m == Backward_Taken)
+        return target <= pc;
+    return m == Taken;
+}
+
+std::string StaticPredictor::name()
+{
+    const char* names[] = {"static not-taken", "static taken", "static backward-taken/forward-not-taken"};
+    return names[m];
+}
+
+bool BimodalPredictor::predict(word pc, word target)
+{
+    return counters[pc & ((1 << bits) - 1)] >= 2;
+}
+
+void BimodalPredictor::update(word pc, bool taken)
+{
+    unsigned char& c = counters[pc & ((1 << bits) - 1)];
+    if(taken && c < 3)
+        c++;
+    else if(!taken && c > 0)
+        c--;
+}
+
+std::string BimodalPredictor::name()
+{
+    return "2-bit, " + std::to_string(1 << bits) + " counters";
+}
+
+bool GsharePredictor::predict(word pc, word target)
+{
+    return counters[(pc ^ history) & ((1 << bits) - 1)] >= 2;
+}
+
+void GsharePredictor::update(word pc, bool taken)
+{
+    unsigned char& c = counters[(pc ^ history) & ((1 << bits) - 1)];
+    if(taken && c < 3)
+        c++;
+    else if(!taken && c > 0)
+        c--;
+    history = ((history << 1) | (taken ? 1 : 0)) & ((1 << bits) - 1);
+}
+
+std::string GsharePredictor::name()
+{
+    return "gshare, " + std::to_string(bits) + "-bit history";
+}
+
+bool pipeline_config::parse(const std::string& spec)
+{
+    std::stringstream strm(spec);
+    std::string p;
+    while(std::getline(strm, p, ','))
+    {
+        std::string key = p.substr(0, p.find('='));
+        int v = p.find('=') == std::string::npos ? 0 : atoi(p.substr(p.find('=') + 1).c_str());
+        if(p == "forward")
+            forwarding = true;
+        else if(p == "noforward")
+            forwarding = false;
+        else if(key == "mem" && v >= 1)
+            mem_latency = v;
+        else if(key == "branch" && v >= 0)
+            branch_penalty = v;
+        else if(key == "indirect" && v >= 0)
+            indirect_penalty = v;
+        else
+            return false;
+    }
+    return true;
+}
+
+void TimingProbe::read(Simulator& sim, word addr)
+{
+    accesses++;
+}
+
+void TimingProbe::write(Simulator& sim, word addr)
+{
+    accesses++;
+}
+
+void TimingProbe::interrupt(Simulator& sim, word vector)
+{
+    cycles += cfg.indirect_penalty;
+    control_stalls += cfg.indirect_penalty;
+    accesses = 0;                           //the pushes of the entry are not an instruction's
+}
+
+void TimingProbe::retire(Simulator& sim, word addr)
+{
+    word instr = sim.IR;
+    int op = instr >> 12;
+    int dr = Simulator::slice(instr, 9, 12), sr1 = Simulator::slice(instr, 6, 9), sr2 = Simulator::slice(instr, 0, 3);
+    int src[3], nsrc = 0, dest = -1;
+    bool sets_cc = false, is_load = false;
+    switch(op)
+    {
+    case 1: case 5:     //ADD, AND
+        src[nsrc++] = sr1;
+        if(!Simulator::bit(instr, 5))
+            src[nsrc++] = sr2;
+        dest = dr;
+        sets_cc = true;
+        break;
+    case 9:             //NOT
+        src[nsrc++] = sr1;
+        dest = dr;
+        sets_cc = true;
+        break;
+    case 2: case 10:    //LD, LDI
+        dest = dr;
+        sets_cc = is_load = true;
+        break;
+    case 6:             //LDR
+        src[nsrc++] = sr1;
+        dest = dr;
+        sets_cc = is_load = true;
+        break;
+    case 14:            //LEA
+        dest = dr;
+        sets_cc = true;
+        break;
+    case 3: case 11:    //ST, STI
+        src[nsrc++] = dr;
+        break;
+    case 7:             //STR
+        src[nsrc++] = dr;
+        src[nsrc++] = sr1;
+        break;
+    case 0:             //BR
+        if(dr != 0 && dr != 7)
+            src[nsrc++] = CC;
+        break;
+    case 12:            //JMP, RET
+        src[nsrc++] = sr1;
+        break;
+    case 4:             //JSR, JSRR
+        if(!Simulator::bit(instr, 11))
+            src[nsrc++] = sr1;
+        dest = 7;
+        break;
+    case 15:            //TRAP
+        dest = 7;
+        break;
+    case 8:             //RTI
+        src[nsrc++] = 6;
+        break;
+    }
+
+    //issue
+    unsigned long long issue = cycles + 1;
+    for(int i = 0; i < nsrc; i++)
+        if(ready[src[i]] > issue)
+        {
+            (load_pending[src[i]] ? load_use_stalls : data_stalls) += ready[src[i]] - issue;
+            issue = ready[src[i]];
+        }
+    unsigned long long mem = (unsigned long long)accesses * (cfg.mem_latency - 1);
+    mem_stalls += mem;
+    issue += mem;
+    accesses = 0;
+
+    //results
+    unsigned long long avail = cfg.forwarding ? issue + (is_load ? 2 : 1) : issue + std::max(1, cfg.stages - 2);
+    if(dest >= 0)
+    {
+        ready[dest] = avail;
+        load_pending[dest] = is_load && cfg.forwarding;
+    }
+    if(sets_cc)
+    {
+        ready[CC] = avail;
+        load_pending[CC] = is_load && cfg.forwarding;
+    }
+
+    //control
+    int penalty = 0;
+    if(op == 0 && dr != 0 && dr != 7)
+    {
+        word target = addr + 1 + Simulator::sign_extend(Simulator::slice(instr, 0, 9), 9);
+        bool taken = (dr & sim.PSR & 7) != 0;
+        bool guess = predictor->predict(addr, target);
+        predictor->update(addr, taken);
+        branch_stat& b = branches[addr];
+        b.executed++;
+        b.taken += taken;
+        if(guess != taken)
+        {
+            b.mispredicted++;
+            penalty = cfg.branch_penalty;
+        }
+    }
+    else if(op == 12 || op == 8 || (op == 4 && !Simulator::bit(instr, 11)) || (op == 15 && instr != 0xf025))
+        penalty = cfg.indirect_penalty;
+    control_stalls += penalty;
+    cycles = issue + penalty;
+    instructions++;
+}
+
+std::string TimingProbe::report(Simulator& sim)
+{
+    std::stringstream strm;
+    unsigned long long total = cycles + cfg.stages - 1;     //and the last instruction drains the pipeline
+    unsigned long long executed = 0, mispredicted = 0;
+    for(std::map<word, branch_stat>::iterator it = branches.begin(); it != branches.end(); ++it)
+    {
+        executed += it->second.executed;
+        mispredicted += it->second.mispredicted;
+    }
+    strm << std::fixed << std::setprecision(3);
+    strm << "pipeline: " << cfg.stages << " stages, " << (cfg.forwarding ? "forwarding" : "no forwarding")
+         << ", memory " << cfg.mem_latency << " cycles, branch penalty " << cfg.branch_penalty
+         << ", indirect penalty " << cfg.indirect_penalty << std::endl;
+    strm << "predictor: " << predictor->name() << std::endl;
+    strm << "instructions " << instructions << "  cycles " << total
+         << "  CPI " << (instructions ? (double)total / instructions : 0.0) << std::endl;
+    strm << "stalls: data " << data_stalls << "  load-use " << load_use_stalls
+         << "  memory " << mem_stalls << "  control " << control_stalls << std::endl;
+    strm << "branches " << executed << "  mispredicted " << mispredicted << "  rate "
+         << std::setprecision(1) << (executed ? 100.0 * mispredicted / executed : 0.0) << "%" << std::endl;
+
+    std::vector<std::pair<unsigned long long, word> > order;
+    for(std::map<word, branch_stat>::iterator it = branches.begin(); it != branches.end(); ++it)
+        order.push_back(std::make_pair(it->second.mispredicted, it->first));
+    std::sort(order.rbegin(), order.rend());
+    strm << "branch   instruction          executed  taken  mispredicted" << std::endl;
+    for(size_t i = 0; i < order.size() && i < 20; i++)
+    {
+        const branch_stat& b = branches[order[i].second];
+        std::vector<std::string> as = sim.instr_to_asm(sim.mem[order[i].second]);
+        std::string text;
+        for(size_t k = 0; k < as.size(); k++)
+            text += (k ? " " : "") + as[k];
+        strm << Simulator::str_fulhex(order[i].second) << "    " << std::left << std::setw(20) << text << std::right
+             << std::setw(9) << b.executed << std::setw(6) << 100.0 * b.taken / b.executed << "%"
+             << std::setw(13) << 100.0 * b.mispredicted / b.executed << "%" << std::endl;
+    }
+    return strm.str();
+}
@@ -0,0 +1,105 @@
+#ifndef TIMING_H_INCLUDED
+#define TIMING_H_INCLUDED
+
+#include "probe.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+//direction predictor of the conditional branches
+class BranchPredictor
+{
+public:
+    virtual ~BranchPredictor(){}
+    virtual bool predict(word pc, word target) = 0;
+    virtual void update(word pc, bool taken){}
+    virtual std::string name() = 0;
+
+    static BranchPredictor* create(const std::string& spec);   //"nt", "t", "btfn", "2bit[:bits]", "gshare[:bits]"; NULL if unknown
+};
+
+class StaticPredictor : public BranchPredictor
+{
+public:
+    enum mode {Not_Taken, Taken, Backward_Taken};
+    mode m;
+
+    StaticPredictor(mode _m) : m(_m) {}
+    bool predict(word pc, word target);
+    std::string name();
+};
+
+//a table of 2-bit saturating counters indexed by the branch address
+class BimodalPredictor : public BranchPredictor
+{
+public:
+    int bits;
+    std::vector<unsigned char> counters;
+
+    BimodalPredictor(int _bits) : bits(_bits), counters(1 << _bits, 1) {}
+    bool predict(word pc, word target);
+    void update(word pc, bool taken);
+    std::string name();
+};
+
+//2-bit counters indexed by the branch address xor the global history
+class GsharePredictor : public BranchPredictor
+{
+public:
+    int bits;
+    unsigned int history = 0;
+    std::vector<unsigned char> counters;
+
+    GsharePredictor(int _bits) : bits(_bits), counters(1 << _bits, 1) {}
+    bool predict(word pc, word target);
+    void update(word pc, bool taken);
+    std::string name();
+};
+
+//the in-order pipeline
+struct pipeline_config
+{
+    int stages = 5;                 //IF ID EX MEM WB
+    bool forwarding = true;         //results bypass to EX; otherwise consumers wait for WB
+    int mem_latency = 1;            //cycles of a data memory access; >1 stalls MEM
+    int branch_penalty = 2;         //cycles lost by a mispredicted branch, resolved in EX
+    int indirect_penalty = 2;       //cycles lost by JMP/JSRR/RET/TRAP/RTI and interrupt entry
+
+    bool parse(const std::string& spec);    //"forward|noforward,mem=N,branch=N,indirect=N"
+};
+
+/*
+    Probe estimating the cycles of an in-order pipeline: an instruction issues one cycle
+    after the previous one, or when its source registers (and the condition codes, for BR)
+    are ready, whichever is later. Loads and stores add mem_latency-1 cycles per access.
+    Conditional branches go through the predictor.
+*/
+class TimingProbe : public Probe
+{
+public:
+    pipeline_config cfg;
+    std::unique_ptr<BranchPredictor> predictor;
+
+    unsigned long long instructions = 0, cycles = 0;
+    unsigned long long data_stalls = 0, load_use_stalls = 0, mem_stalls = 0, control_stalls = 0;
+
+    TimingProbe(const pipeline_config& c, BranchPredictor* p) : cfg(c), predictor(p) {}
+    void read(Simulator& sim, word addr);
+    void write(Simulator& sim, word addr);
+    void retire(Simulator& sim, word addr);
+    void interrupt(Simulator& sim, word vector);
+    std::string report(Simulator& sim);
+
+private:
+    struct branch_stat
+    {
+        unsigned long long executed = 0, taken = 0, mispredicted = 0;
+    };
+    std::map<word, branch_stat> branches;
+    unsigned long long ready[9] = {0};      //cycle each of R0-R7 and the condition codes can be used
+    bool load_pending[9] = {false};         //ready[] is the result of a load
+    int accesses = 0;                       //data accesses of the instruction retiring
+};
+
+#endif // TIMING_H_INCLUDED
@@ -0,0 +1,252 @@
+#include "translate.h"
+#include "cfg.h"
+#include "decode.h"
+#include "sim.h"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+static std::vector<const translated_program*>& registry()
+{
+    static std::vector<const translated_program*> programs;
+    return programs;
+}
+
+void register_translation(const translated_program* p)
+{
+    registry().push_back(p);
+}
+
+const std::vector<const translated_program*>& translations()
+{
+    return registry();
+}
+
+static std::string hex(word x)
+{
+    std::stringstream strm;
+    strm << "0x" << std::hex << x;
+    return strm.str();
+}
+
+//the call of the instruction h, decoded as process_instr() does
+static std::string instr_call(word h)
+{
+    int dr = Simulator::slice(h, 9, 12), sr = Simulator::slice(h, 6, 9), sr2 = Simulator::slice(h, 0, 3);
+    std::stringstream strm;
+    switch(h>>12)
+    {
+    case 0:
+        strm << "s.BR(" << dr << ", " << hex(Simulator::slice(h, 0, 9)) << ");";
+        break;
+    case 1:
+    case 5:
+        strm << "s." << (h>>12 == 1 ? "ADD" : "AND");
+        if(Simulator::bit(h, 5))
+            strm << "imm(" << dr << ", " << sr << ", " << hex(Simulator::slice(h, 0, 5)) << ");";
+        else
+            strm << "(" << dr << ", " << sr << ", " << sr2 << ");";
+        break;
+    case 2: case 3: case 10: case 11: case 14:
+    {
+        static const char* names[16] = {"", "", "LD", "ST", "", "", "", "", "", "", "LDI", "STI", "", "", "LEA", ""};
+        strm << "s." << names[h>>12] << "(" << dr << ", " << hex(Simulator::slice(h, 0, 9)) << ");";
+        break;
+    }
+    case 4:
+        if(Simulator::bit(h, 11))
+            strm << "s.JSR(" << hex(Simulator::slice(h, 0, 11)) << ");";
+        else
+            strm << "s.JSRR(" << sr << ");";
+        break;
+    case 6:
+    case 7:
+        strm << "s." << (h>>12 == 6 ? "LDR" : "STR") << "(" << dr << ", " << sr << ", " << hex(Simulator::slice(h, 0, 6)) << ");";
+        break;
+    case 8:
+        strm << "s.RTI();";
+        break;
+    case 9:
+        strm << "s.NOT(" << dr << ", " << sr << ");";
+        break;
+    case 12:
+        strm << "s.JMP(" << sr << ");";
+        break;
+    case 13:
+        strm << "if(s.extensions)" << std::endl
+             << "            s.EXT(" << dr << ", " << sr << ", " << Simulator::slice(h, 3, 6) << ", " << sr2 << ");";
+        break;
+    case 15:
+        strm << "s.TRAP(" << hex(Simulator::slice(h, 0, 8)) << ");";
+        break;
+    }
+    return strm.str();
+}
+
+std::string translate(Simulator& sim, const ControlFlowGraph& cfg, const std::string& name, word from, word to)
+{
+    std::stringstream strm;
+    strm << "//translated by lc3translate from the image " << name << "; do not edit" << std::endl
+         << "#include \"translate.h\"" << std::endl
+         << "#include \"sim.h\"" << std::endl << std::endl
+         << "namespace" << std::endl << "{" << std::endl;
+
+    std::vector<const basic_block*> blocks;
+    for(std::map<word, basic_block>::const_iterator it = cfg.blocks.begin(); it != cfg.blocks.end(); ++it)
+        if(it->first >= from && it->first <= to)
+            blocks.push_back(&it->second);
+
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        word start = blocks[i]->start, length = blocks[i]->end - start + 1;
+        strm << std::endl << "const word c_" << std::hex << start << std::dec << "[] = {";
+        for(word k = 0; k < length; k++)
+            strm << (k ? ", " : "") << hex(sim.mem[start + k]);
+        strm << "};" << std::endl << std::endl
+             << "void b_" << std::hex << start << std::dec << "(Simulator& s, unsigned long long stop)" << std::endl
+             << "{" << std::endl
+             << "    switch(s.PC)" << std::endl
+             << "    {" << std::endl;
+        for(word k = 0; k < length; k++)
+        {
+            word addr = start + k, h = sim.mem[addr];
+            std::vector<std::string> as = sim.instr_to_asm(h);
+            std::string text = as[0];
+            for(size_t j = 1; j < as.size(); j++)
+                text += (j == 1 ? " " : ", ") + as[j];
+            strm << "    case " << hex(addr) << ":        //" << text << std::endl;
+            if(k > 0)
+                strm << "        if(s.cycle >= stop || s.cycle >= s.next_event)" << std::endl
+                     << "            return;" << std::endl;
+            strm << "        s.MAR = " << hex(addr) << "; s.PC = " << hex(addr + 1) << "; s.MDR = s.IR = " << hex(h)
+                 << "; s.metrics.opcodes[" << (h>>12) << "]++;" << std::endl;
+
+            //stores that may change this block's code end the call; the runner checks the code again
+            bool leave = false;
+            word target;
+            if(h>>12 == 7)
+                strm << "        {" << std::endl
+                     << "        word t = s.gen_reg[" << Simulator::slice(h, 6, 9) << "] + " << hex(Simulator::sign_extend(Simulator::slice(h, 0, 6), 6)) << ";" << std::endl
+                     << "        " << instr_call(h) << std::endl
+                     << "        s.HistoryCount++; s.cycle++;" << std::endl
+                     << "        if((word)(t - " << hex(start) << ") < " << length << ")" << std::endl
+                     << "            return;" << std::endl
+                     << "        }" << std::endl;
+            else
+            {
+                strm << "        " << instr_call(h) << std::endl
+                     << "        s.HistoryCount++; s.cycle++;" << std::endl;
+                if(h>>12 == 3 && Simulator::pc_target(addr, h, target))
+                    leave = (word)(target - start) < length;
+                leave = leave || h>>12 == 11 || (h>>12 == 13 && Simulator::slice(h, 3, 6) >= 6);
+                if(h>>12 == 8 || h>>12 == 15)
+                    strm << "        if(s.sim_status != Simulator::Normal)" << std::endl
+                         << "            return;" << std::endl;
+            }
+            if(leave && k + 1 < length)
+                strm << "        return;" << std::endl;
+        }
+        strm << "    }" << std::endl << "}" << std::endl;
+    }
+
+    strm << std::endl;
+    if(!blocks.empty())
+    {
+        strm << "const translated_block blocks[] =" << std::endl << "{" << std::endl;
+        for(size_t i = 0; i < blocks.size(); i++)
+        {
+            word start = blocks[i]->start;
+            strm << "    {" << hex(start) << ", " << blocks[i]->end - start + 1 << ", c_" << std::hex << start
+                 << ", b_" << start << std::dec << "}," << std::endl;
+        }
+        strm << "};" << std::endl;
+    }
+    strm << std::endl << "}" << std::endl << std::endl
+         << "extern const translated_program aot_" << name << ";" << std::endl
+         << "const translated_program aot_" << name << " = {\"" << name << "\", "
+         << (blocks.empty() ? "NULL" : "blocks") << ", " << blocks.size() << "};" << std::endl << std::endl
+         << "static const bool registered = (register_translation(&aot_" << name << "), true);" << std::endl;
+    return strm.str();
+}
+
+void TranslatedRunner::attach()
+{
+    std::fill(table.begin(), table.end(), (const translated_block*)NULL);
+    std::fill(pages.begin(), pages.end(), (const decoded_page*)NULL);
+    const std::vector<const translated_program*>& programs = translations();
+    for(size_t p = 0; p < programs.size(); p++)
+        for(int i = 0; i < programs[p]->count; i++)
+        {
+            const translated_block* b = &programs[p]->blocks[i];
+            if(memcmp(sim.mem + b->start, b->code, sizeof(word) * b->length) != 0)
+                continue;
+            for(word k = 0; k < b->length; k++)
+                if(table[b->start + k] == NULL)
+                    table[b->start + k] = b;
+        }
+}
+
+void TranslatedRunner::run(long long steps)
+{
+    if(sim.features() & ~Simulator::Run_Events)
+    {
+        sim.run(steps);
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long long count = sim.HistoryCount;
+    unsigned long long stop = sim.cycle + steps;
+    sim.sim_status = Simulator::Normal;
+    while(sim.cycle < stop)
+    {
+        word pc = sim.PC;
+        const translated_block* b = table[pc];
+        int n = 0;                      //steps run; the interpreter takes one if none, and the device events
+        if(sim.cycle >= sim.next_event)
+            ;
+        else if(b != NULL && memcmp(sim.mem + pc, b->code + (pc - b->start), sizeof(word) * (b->start + b->length - pc)) == 0)
+        {
+            b->run(sim, stop);
+            blocks_run++;
+            n = 1;
+        }
+        else if(cache != NULL && pc < 0xfe00)
+        {
+            //the page is decoded again if its code has changed since
+            const decoded_page*& page = pages[pc>>8];
+            if(page == NULL || page->code[pc & 0xff].instr != sim.mem[pc])
+                page = cache->get(sim.mem + (pc & 0xff00));
+            n = run_decoded(sim, *page, stop);
+            decoded_steps += n;
+        }
+        if(n == 0)
+        {
+            //the interpreter, with the due device events, till the entry of a translation or a decodable page
+            do
+            {
+                sim.step<Simulator::Run_Events>();
+                fallbacks++;
+            }
+            while(sim.sim_status == Simulator::Normal && sim.cycle < stop && table[sim.PC] == NULL && (cache == NULL || sim.PC >= 0xfe00));
+        }
+        if(sim.sim_status != Simulator::Normal)
+            break;
+    }
+    sim.metrics.run_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    sim.metrics.run_instructions += sim.HistoryCount - count;
+}
+
+std::string TranslatedRunner::report()
+{
+    std::stringstream strm;
+    int blocks = 0;
+    for(int a = 0; a < 0x10000; a++)
+        blocks += table[a] != NULL && table[a]->start == a;
+    strm << "aot: " << blocks << " blocks translated, " << blocks_run << " block runs, ";
+    if(cache != NULL)
+        strm << decoded_steps << " steps decoded, ";
+    strm << fallbacks << " interpreted steps" << std::endl;
+    if(cache != NULL)
+        strm << cache->report();
+    return strm.str();
+}
@@ -0,0 +1,63 @@
+#ifndef TRANSLATE_H_INCLUDED
+#define TRANSLATE_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+typedef unsigned short int word;
+
+class Simulator;
+class ControlFlowGraph;
+class DecodeCache;
+struct decoded_page;
+
+/*
+    Ahead-of-time translation. lc3translate turns the basic blocks of a memory image into
+    C++: one function per block, a case per instruction, calling the inline instructions of
+    Simulator with the fields decoded. The build compiles the translations of the built-in
+    OS, the bench workloads and the images of LC3_TRANSLATE into the lc3aot objects, each
+    of which registers its program with register_translation() when it is loaded.
+
+    A block function starts at the instruction at PC. Before each instruction it returns if
+    the budget is spent or a device event is due, and after a store that may have changed
+    its own code. The runner takes a block only if its words from PC on are those it was
+    translated from, and runs the interpreter for everything else: indirect jumps to code
+    never translated, self-modified code, interrupt entries and the device events.
+*/
+struct translated_block
+{
+    word start, length;
+    const word* code;                   //the words it was translated from
+    void (*run)(Simulator& s, unsigned long long stop);        //from PC till cycle stop at most
+};
+
+struct translated_program
+{
+    const char* name;
+    const translated_block* blocks;
+    int count;
+};
+
+void register_translation(const translated_program* p);
+const std::vector<const translated_program*>& translations();
+
+//C++ source defining translated_program aot_<name> with the blocks of cfg in [from, to]
+std::string translate(Simulator& sim, const ControlFlowGraph& cfg, const std::string& name, word from, word to);
+
+//runs a simulator on the registered translations, and with a cache on decoded pages where none applies
+class TranslatedRunner
+{
+public:
+    Simulator& sim;
+    DecodeCache* cache = NULL;
+    std::vector<const translated_block*> table;        //by address, for each instruction of a block
+    std::vector<const decoded_page*> pages;             //the decode of each page of memory, taken when first run
+    unsigned long long blocks_run = 0, decoded_steps = 0, fallbacks = 0;        //block function calls, steps of decoded pages, interpreted steps
+
+    TranslatedRunner(Simulator& _sim) : sim(_sim), table(0x10000), pages(0x100) {}
+    void attach();                      //take the blocks of every translation matching the memory now
+    void run(long long steps);          //like Simulator::run(steps); the interpreter alone if a probe, a breakpoint, the trace or the profile is on
+    std::string report();
+};
+
+#endif // TRANSLATE_H_INCLUDED
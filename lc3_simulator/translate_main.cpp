@@ -0,0 +1,74 @@
+/*
+    lc3translate out.cpp name [--ext] [image...]
+
+    Writes the translation of the built-in OS, or with images (.asm or .bin) the
+    translation of their code outside the OS, as the translated_program aot_<name>.
+    --ext decodes 1101 as the extension ops in images assembled here.
+*/
+#include "cfg.h"
+#include "os_image.h"
+#include "sim.h"
+#include "translate.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: lc3translate out.cpp name [--ext] [image...]\n");
+        return 5;
+    }
+    std::unique_ptr<Simulator> simp(new Simulator());
+    Simulator& sim = *simp;
+    sim.initialize();
+
+    std::vector<word> entries;
+    bool images = false;
+    for(int i = 3; i < argc; i++)
+    {
+        std::string file = argv[i];
+        if(file == "--ext")
+        {
+            sim.extensions = true;
+            continue;
+        }
+        bool ok;
+        if(file.size() > 4 && file.substr(file.size() - 4) == ".asm")
+        {
+            std::vector<word> bin;
+            ok = sim.assemble(file, bin) && sim.load_words(bin);
+        }
+        else
+            ok = sim.load_bin(file);
+        if(!ok)
+        {
+            fprintf(stderr, "%s: %s", file.c_str(), sim.message().str().c_str());
+            return 5;
+        }
+        entries.push_back(sim.load_origin);
+        images = true;
+    }
+
+    //the OS alone: its trap and interrupt routines; else the images from their origins too
+    std::vector<word> all = ControlFlowGraph::default_entries(sim);
+    all.insert(all.end(), entries.begin(), entries.end());
+    ControlFlowGraph cfg;
+    cfg.analyze(sim, all);
+
+    word os_end = os_image_start + os_image_size - 1;
+    std::string source = images ? translate(sim, cfg, argv[2], os_end + 1, 0xfdff)
+                                : translate(sim, cfg, argv[2], os_image_start, os_end);
+    std::ofstream out(argv[1]);
+    out << source;
+    if(!out)
+    {
+        fprintf(stderr, "cannot write %s\n", argv[1]);
+        return 5;
+    }
+    return 0;
+}
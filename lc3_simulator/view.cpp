@@ -0,0 +1,162 @@
+#include "view.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+bool SimView::cmd(char str[])
+{
+    std::string s;
+    std::string p1;
+    std::stringstream strm(str);
+    strm >> s;
+    if(s=="showmem"||s=="smm")
+    {
+        if(strm >> p1)
+        {
+            word v1;
+            try
+            {
+                v1 = Simulator::to_word(p1);
+                vtrackPC = false;
+                vstart = v1;
+            }
+            catch(int ex)
+            {
+                sim.message() << "Cannot recognize " << p1 << std::endl;
+            }
+        }
+        else
+        {
+            vtrackPC = true;
+        }
+
+    }
+    else if(s=="select"||s=="w")
+    {
+        sim.message() << "Press ESC to back to CMD mode" <<std::endl;
+        sim.sim_status = Simulator::Select;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void SimView::refresh()
+{
+    term.clear_screen();
+    show_status();
+    show_mem();
+    show_message();
+}
+
+void SimView::show_mem(int _start, int _end)
+{
+    //cursor_xy(0, 3);
+
+    term.text_color(0x70);
+    printf("    Loc     |        Bin          |   Hex   |       Instruction        \n");
+    term.text_color(0x07);
+
+    std::string fstr;
+    unsigned short int bcolor, fcolor;
+    for(int i=_start; i<_end; i++)
+    {
+        //get the foreground and background color
+        if(sim.PC==i)
+        {
+            bcolor =(sim.sim_status==Simulator::Select&&(vselect==i||vjump==i))?0x00e0:0x0060;
+            fcolor = 0x0000;
+        }
+        else if(sim.sim_status==Simulator::Select&&vselect==i)
+        {
+            bcolor = 0x0070;
+            fcolor = 0x0000;
+        }
+        else if(sim.sim_status==Simulator::Select&&vjump==i)
+        {
+            bcolor = 0x0080;
+            fcolor = 0x0000;
+        }
+        else
+        {
+            bcolor = 0x0000;
+            fcolor = 0x0007;
+        }
+
+        term.text_color(bcolor+fcolor);
+
+        if(sim.is_bk(i))
+            {term.text_color(0x04 + bcolor); printf("��");}
+        else
+            printf("  ");
+        if(sim.PC==i)
+            {printf(">>>");}
+        else
+            printf("   ");
+        std::cout << fstr;
+
+        term.text_color(bcolor+fcolor);
+
+        printf("%s        ", sim.str_fulhex(i).c_str());
+        std::cout << sim.word_to_bin(sim.mem[i]) << "   " ;
+        printf("%s           ", sim.str_fulhex(sim.mem[i]).c_str());
+        std::vector<std::string> asmstr = sim.instr_to_asm(sim.mem[i]);
+        term.text_color(0x09+bcolor);
+        std::cout << asmstr[0] << "  " ;
+        term.text_color(fcolor+bcolor);
+        for(int i = 1; i < (int)asmstr.size(); i++)
+        {
+            std::cout << asmstr[i] << "  " ;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void SimView::show_mem()
+{
+    term.cursor_xy(0, 3);
+    if(vtrackPC)
+    {
+        vstart = sim.PC-5 > 0 ? sim.PC-5 : 0;
+    }
+    show_mem(vstart, (vstart+25<0x10000)?(vstart+25):0x10000);
+}
+
+void SimView::show_status()
+{
+    term.cursor_xy(0, 0);
+    printf("PC: %s         IR: %s        PSR: %s         CC: %c\n", sim.str_fulhex(sim.PC).c_str(), sim.str_fulhex(sim.IR).c_str(), sim.str_fulhex(sim.PSR).c_str(), sim.bit(sim.PSR, 0)?'p':(sim.bit(sim.PSR, 1)?'z':'n'));
+    for(int i = 0;i<=3;i++)
+    {
+        printf("R%d: %s %6hd  ",i, sim.str_fulhex(sim.gen_reg[i]).c_str(), sim.gen_reg[i]);
+    }
+    printf("\n");
+    for(int i = 4;i<=7;i++)
+    {
+        printf("R%d: %s %6hd  ",i, sim.str_fulhex(sim.gen_reg[i]).c_str(), sim.gen_reg[i]);
+    }
+    printf("\n");
+
+}
+
+void SimView::show_message()
+{
+    //cursor_xy(0, 29);
+    //std::string s;
+    printf("\n");
+    term.text_color(0x00b0);
+    printf("                                Message                                \n");
+    term.text_color(0x0007);
+    std::cout << sim.message().str();
+    printf("\n");
+    sim.message().str("");
+    printf("Instructions Executed: %llu                 Status: ", sim.HistoryCount);
+    if(sim.sim_status==Simulator::Normal) printf("Normal\n");
+    else if(sim.sim_status==Simulator::Breakpoint)printf("Breakpoint\n");
+    else if(sim.sim_status==Simulator::Priviledge_Exception)printf("Priviledge_Exception\n");
+    else if(sim.sim_status==Simulator::User_Interrupt)printf("User Interrupt\n");
+    else if(sim.sim_status==Simulator::Select)printf("Select\n");
+    else if(sim.sim_status==Simulator::Halt)printf("Halted\n");
+}
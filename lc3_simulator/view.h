@@ -0,0 +1,29 @@
+#ifndef VIEW_H_INCLUDED
+#define VIEW_H_INCLUDED
+
+#include "sim.h"
+#include "terminal.h"
+
+//draws the registers, the memory window and the messages of a simulator on a console.
+class SimView
+{
+public:
+    Simulator& sim;
+    Terminal& term;
+
+    int vstart;                             //first location of the memory window
+    bool vtrackPC;                          //keep PC in the memory window
+    int vselect;                            //selected location in select mode
+    word vjump;                             //branch target of the selected location
+
+    SimView(Simulator& s, Terminal& t): sim(s), term(t), vstart(0), vtrackPC(true), vselect(0), vjump(-1) {}
+
+    bool cmd(char str[]);                   //execute a command of the view; false if it is not one
+    void refresh();                         //redraw the whole screen
+    void show_mem(int _start, int _end);    //show part of mem
+    void show_mem();                        //show the memory window
+    void show_message();
+    void show_status();
+};
+
+#endif // VIEW_H_INCLUDED